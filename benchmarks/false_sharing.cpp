@@ -0,0 +1,203 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <omp.h>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/global_control.h>
+#include <tbb/tick_count.h>
+
+#include "perthread.h"
+
+// Compares ways of combining per-thread counts, for OpenMP and TBB threads:
+//
+//   atomic   - every thread increments one shared std::atomic (contended)
+//   array    - each thread increments its own element of a plain array, so
+//              neighbouring threads' counters share a cache line (false sharing)
+//   padded   - each thread increments its own part1::PerThread slot, which
+//              has a cache line to itself
+//
+// Every thread stores to its counter on every iteration (as a loop that
+// calls a function would), so the cost of the cache line moving between
+// cores is not hidden by the compiler keeping the count in a register.
+//
+// Compile with
+//   g++ -O3 -falign-loops=64 -fopenmp -I../intro_to_intel_tbb/workshop/include
+//       false_sharing.cpp -o false_sharing -ltbb
+// The loops are tiny, so without -falign-loops their speed on one thread can
+// differ by 3x just because of where they happen to sit in memory.
+//
+// usage: false_sharing [increments_per_thread]
+
+// a plain counter, with no padding, so eight share a 64-byte cache line
+struct Unpadded
+{
+    uint64_t value;
+};
+
+// increment through a volatile reference, so every increment is a store
+inline void bump(uint64_t &counter)
+{
+    volatile uint64_t &c = counter;
+    c = c + 1;
+}
+
+double openmp_run(const std::string &mode, int nthreads, uint64_t n)
+{
+    std::atomic<uint64_t> shared(0);
+    std::vector<Unpadded> array(nthreads, Unpadded{0});
+    part1::PerThread<uint64_t, part1::OpenMPThreadIndex> padded(nthreads, 0);
+
+    auto start = tbb::tick_count::now();
+
+    #pragma omp parallel num_threads(nthreads)
+    {
+        const int id = omp_get_thread_num();
+
+        if (mode == "atomic")
+        {
+            for (uint64_t i = 0; i < n; i++)
+            {
+                shared.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        else if (mode == "array")
+        {
+            for (uint64_t i = 0; i < n; i++)
+            {
+                bump(array[id].value);
+            }
+        }
+        else
+        {
+            uint64_t &counter = padded.local();
+
+            for (uint64_t i = 0; i < n; i++)
+            {
+                bump(counter);
+            }
+        }
+    }
+
+    double seconds = (tbb::tick_count::now() - start).seconds();
+
+    uint64_t total = shared;
+
+    for (const Unpadded &c : array)
+    {
+        total += c.value;
+    }
+
+    total += padded.combine(std::plus<uint64_t>());
+
+    if (total != n * nthreads)
+    {
+        std::cerr << "wrong total for " << mode << ": " << total << std::endl;
+    }
+
+    return seconds;
+}
+
+double tbb_run(const std::string &mode, int nthreads, uint64_t n)
+{
+    tbb::global_control control(tbb::global_control::max_allowed_parallelism, nthreads);
+
+    std::atomic<uint64_t> shared(0);
+    std::vector<Unpadded> array(nthreads, Unpadded{0});
+    part1::PerThread<uint64_t, part1::TBBThreadIndex> padded(nthreads, 0);
+
+    auto start = tbb::tick_count::now();
+
+    // one task per thread, each doing n increments
+    tbb::parallel_for( tbb::blocked_range<int>(0, nthreads, 1), [&](const tbb::blocked_range<int> &r)
+    {
+        for (int t = r.begin(); t < r.end(); t++)
+        {
+            if (mode == "atomic")
+            {
+                for (uint64_t i = 0; i < n; i++)
+                {
+                    shared.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            else if (mode == "array")
+            {
+                // index by task, not by tbb::this_task_arena::current_thread_index(),
+                // which is the thread's slot in the default arena and can be
+                // nthreads or more even when global_control limits the threads
+                for (uint64_t i = 0; i < n; i++)
+                {
+                    bump(array[t].value);
+                }
+            }
+            else
+            {
+                uint64_t &counter = padded.local();
+
+                for (uint64_t i = 0; i < n; i++)
+                {
+                    bump(counter);
+                }
+            }
+        }
+    }, tbb::simple_partitioner());
+
+    double seconds = (tbb::tick_count::now() - start).seconds();
+
+    uint64_t total = shared;
+
+    for (const Unpadded &c : array)
+    {
+        total += c.value;
+    }
+
+    total += padded.combine(std::plus<uint64_t>());
+
+    if (total != n * nthreads)
+    {
+        std::cerr << "wrong total for " << mode << ": " << total << std::endl;
+    }
+
+    return seconds;
+}
+
+int main(int argc, char **argv)
+{
+    const uint64_t n = (argc > 1) ? std::stoull(argv[1]) : 50000000;
+    const int max_threads = omp_get_num_procs();
+
+    const std::vector<std::string> modes = { "atomic", "array", "padded" };
+
+    std::cout << "library,threads";
+
+    for (const auto &mode : modes)
+    {
+        std::cout << "," << mode << "_increments_per_s";
+    }
+
+    std::cout << std::endl;
+
+    for (int nthreads = 1; nthreads <= max_threads; nthreads = (nthreads < max_threads && 2*nthreads > max_threads) ? max_threads : 2*nthreads)
+    {
+        for (const std::string library : { "openmp", "tbb" })
+        {
+            std::cout << library << "," << nthreads;
+
+            for (const auto &mode : modes)
+            {
+                double seconds = (library == "openmp") ? openmp_run(mode, nthreads, n)
+                                                       : tbb_run(mode, nthreads, n);
+
+                std::cout << "," << double(n) * nthreads / seconds;
+            }
+
+            std::cout << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,501 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <omp.h>
+
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/blocked_range.h>
+#include <tbb/partitioner.h>
+#include <tbb/global_control.h>
+#include <tbb/tick_count.h>
+#include <tbb/version.h>
+
+// The counter-based random number generator from the TBB workshop
+#include "philox.h"
+
+// Measures how the OpenMP and TBB examples scale with the number of threads.
+//
+// Each kernel is the loop of one of the examples (pi_estimate_reduction.cpp
+// and fixed_loopcount.cpp from intro_to_openmp, parallel_for.cpp and
+// parallel_reduce.cpp from the TBB workshop), with a bigger problem size.
+// Every kernel is run with every thread count and every loop schedule
+// (OpenMP, set with omp_set_schedule and used through schedule(runtime))
+// or partitioner (TBB), and every run is repeated. For each combination
+// the mean, standard deviation and minimum time are reported, together with
+// the speedup over one thread and the parallel efficiency (speedup / threads).
+//
+// The thread binding (OMP_PROC_BIND, OMP_PLACES) is recorded with the
+// results, as it changes the scaling, e.g.
+//   OMP_PROC_BIND=close OMP_PLACES=cores ./scaling -f json -o close.json
+//
+// Compile with
+//   g++ -O3 -fopenmp -I../intro_to_intel_tbb/workshop/include scaling.cpp -o scaling -ltbb
+//
+// usage: scaling [-t 1,2,4,8] [-r repeats] [-k kernel] [-s size_scale]
+//                [-f csv|json] [-o output_file]
+
+struct Config
+{
+    std::vector<int> threads;
+    int repeats = 5;
+    std::string kernel;
+    double size_scale = 1.0;
+    std::string format = "csv";
+    std::string output;
+};
+
+// One way of splitting up a loop: an OpenMP schedule or a TBB partitioner
+struct Schedule
+{
+    std::string name;
+
+    omp_sched_t kind;
+    int chunk;
+
+    enum class Partitioner { None, Auto, Simple, Static, Affinity } partitioner;
+    size_t grainsize;
+};
+
+std::vector<Schedule> openmp_schedules()
+{
+    typedef Schedule::Partitioner P;
+
+    return {
+        { "static",       omp_sched_static,  0,    P::None, 0 },
+        { "static,64",    omp_sched_static,  64,   P::None, 0 },
+        { "dynamic,1",    omp_sched_dynamic, 1,    P::None, 0 },
+        { "dynamic,64",   omp_sched_dynamic, 64,   P::None, 0 },
+        { "guided",       omp_sched_guided,  0,    P::None, 0 },
+        { "guided,16",    omp_sched_guided,  16,   P::None, 0 }
+    };
+}
+
+std::vector<Schedule> tbb_partitioners()
+{
+    typedef Schedule::Partitioner P;
+
+    return {
+        { "auto",             omp_sched_static, 0, P::Auto,     1 },
+        { "simple,grain=1k",  omp_sched_static, 0, P::Simple,   1024 },
+        { "simple,grain=64k", omp_sched_static, 0, P::Simple,   65536 },
+        { "static",           omp_sched_static, 0, P::Static,   1 },
+        { "affinity",         omp_sched_static, 0, P::Affinity, 1 }
+    };
+}
+
+// Run tbb::parallel_for over [0,n) using the partitioner of 'schedule'
+template<class FUNC>
+void tbb_for(size_t n, const Schedule &schedule, FUNC func)
+{
+    tbb::blocked_range<size_t> range(0, n, schedule.grainsize);
+
+    switch (schedule.partitioner)
+    {
+        case Schedule::Partitioner::Simple:
+            tbb::parallel_for(range, func, tbb::simple_partitioner());
+            break;
+        case Schedule::Partitioner::Static:
+            tbb::parallel_for(range, func, tbb::static_partitioner());
+            break;
+        case Schedule::Partitioner::Affinity:
+        {
+            // an affinity_partitioner only helps if it is reused, so
+            // keep one per call site
+            static tbb::affinity_partitioner affinity;
+            tbb::parallel_for(range, func, affinity);
+            break;
+        }
+        default:
+            tbb::parallel_for(range, func, tbb::auto_partitioner());
+    }
+}
+
+// Run tbb::parallel_reduce of doubles over [0,n) using the partitioner of 'schedule'
+template<class FUNC>
+double tbb_sum(size_t n, const Schedule &schedule, FUNC func)
+{
+    tbb::blocked_range<size_t> range(0, n, schedule.grainsize);
+
+    switch (schedule.partitioner)
+    {
+        case Schedule::Partitioner::Simple:
+            return tbb::parallel_reduce(range, 0.0, func, std::plus<double>(), tbb::simple_partitioner());
+        case Schedule::Partitioner::Static:
+            return tbb::parallel_reduce(range, 0.0, func, std::plus<double>(), tbb::static_partitioner());
+        case Schedule::Partitioner::Affinity:
+        {
+            static tbb::affinity_partitioner affinity;
+            return tbb::parallel_reduce(range, 0.0, func, std::plus<double>(), affinity);
+        }
+        default:
+            return tbb::parallel_reduce(range, 0.0, func, std::plus<double>(), tbb::auto_partitioner());
+    }
+}
+
+// A kernel returns a checksum, so that the compiler cannot remove the work
+// and so that runs with different schedules can be checked against each other
+struct Kernel
+{
+    std::string name;
+    std::string library;
+    std::function<double(int nthreads, const Schedule&, double scale)> run;
+};
+
+std::vector<Kernel> kernels()
+{
+    return {
+        // intro_to_openmp/pi_estimate_reduction.cpp: blocks of points, each
+        // with its own Philox stream, counted with a reduction
+        { "pi_estimate_reduction", "openmp", [](int nthreads, const Schedule&, double scale)
+        {
+            const uint64_t n_blocks = std::max<uint64_t>(1, uint64_t(256 * scale));
+            const uint64_t block_size = 1 << 15;
+            uint64_t pts_inside = 0;
+
+            #pragma omp parallel for num_threads(nthreads) schedule(runtime) reduction(+ : pts_inside)
+            for (uint64_t b = 0; b < n_blocks; b++)
+            {
+                part1::Philox4x32 generator(42, b);
+
+                for (uint64_t i = 0; i < block_size; i++)
+                {
+                    // draw the words one at a time, as the order in which function
+                    // arguments are evaluated differs between compilers
+                    const uint32_t x_hi = generator();
+                    const uint32_t x_lo = generator();
+                    const uint32_t y_hi = generator();
+                    const uint32_t y_lo = generator();
+                    double x = 2.0 * part1::to_unit_double(x_hi, x_lo) - 1.0;
+                    double y = 2.0 * part1::to_unit_double(y_hi, y_lo) - 1.0;
+                    pts_inside += (x*x + y*y <= 1.0) ? 1 : 0;
+                }
+            }
+
+            return 4.0 * pts_inside / (n_blocks * block_size);
+        }},
+
+        // intro_to_openmp/fixed_loopcount.cpp: private counters added
+        // together in a critical section
+        { "fixed_loopcount", "openmp", [](int nthreads, const Schedule&, double scale)
+        {
+            const int64_t n = std::max<int64_t>(1, int64_t(2e8 * scale));
+            int64_t global_nloops = 0;
+
+            #pragma omp parallel num_threads(nthreads)
+            {
+                int64_t private_nloops = 0;
+
+                #pragma omp for schedule(runtime)
+                for (int64_t i = 0; i < n; ++i)
+                {
+                    // add one or two, depending on a hash of i, so that
+                    // the compiler cannot replace the loop with a formula
+                    private_nloops += ((i * 0x9E3779B97F4A7C15ull) >> 63) + 1;
+                }
+
+                #pragma omp critical
+                {
+                    global_nloops += private_nloops;
+                }
+            }
+
+            return double(global_nloops);
+        }},
+
+        // intro_to_intel_tbb/workshop/parallel_for.cpp: fill a vector
+        { "parallel_for", "tbb", [](int, const Schedule &schedule, double scale)
+        {
+            std::vector<double> values( std::max<size_t>(1, size_t(2e7 * scale)) );
+
+            tbb_for(values.size(), schedule, [&](const tbb::blocked_range<size_t> &r)
+            {
+                for (size_t i=r.begin(); i<r.end(); ++i)
+                {
+                    values[i] = std::sin(i * 0.001);
+                }
+            });
+
+            return values[values.size() / 2];
+        }},
+
+        // intro_to_intel_tbb/workshop/parallel_reduce.cpp: sum of sin(i * 0.001)
+        { "parallel_reduce", "tbb", [](int, const Schedule &schedule, double scale)
+        {
+            const size_t n = std::max<size_t>(1, size_t(2e7 * scale));
+
+            return tbb_sum(n, schedule, [&](const tbb::blocked_range<size_t> &r, double running_total)
+            {
+                for (size_t i=r.begin(); i<r.end(); ++i)
+                {
+                    running_total += std::sin(i * 0.001);
+                }
+
+                return running_total;
+            });
+        }}
+    };
+}
+
+struct Measurement
+{
+    std::string kernel;
+    std::string library;
+    std::string schedule;
+    int threads;
+    int repeats;
+    double mean;
+    double stddev;
+    double min;
+    double speedup;
+    double efficiency;
+    double checksum;
+};
+
+std::string getenv_or(const char *name, const std::string &fallback)
+{
+    const char *value = std::getenv(name);
+    return value ? value : fallback;
+}
+
+std::string proc_bind_name(omp_proc_bind_t bind)
+{
+    switch (bind)
+    {
+        case omp_proc_bind_false: return "false";
+        case omp_proc_bind_true: return "true";
+        case omp_proc_bind_master: return "master";
+        case omp_proc_bind_close: return "close";
+        case omp_proc_bind_spread: return "spread";
+        default: return "unknown";
+    }
+}
+
+// Describe the machine and the thread binding the results were measured with
+std::vector<std::pair<std::string,std::string>> environment()
+{
+    return {
+        { "num_procs", std::to_string(omp_get_num_procs()) },
+        { "omp_max_threads", std::to_string(omp_get_max_threads()) },
+        { "OMP_PROC_BIND", getenv_or("OMP_PROC_BIND", "") },
+        { "OMP_PLACES", getenv_or("OMP_PLACES", "") },
+        { "proc_bind", proc_bind_name(omp_get_proc_bind()) },
+        { "num_places", std::to_string(omp_get_num_places()) },
+        { "OMP_NUM_THREADS", getenv_or("OMP_NUM_THREADS", "") },
+        { "TBB_VERSION", std::to_string(TBB_VERSION_MAJOR) + "." + std::to_string(TBB_VERSION_MINOR) }
+    };
+}
+
+std::string json_string(const std::string &s)
+{
+    std::string out = "\"";
+
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+        }
+
+        out += c;
+    }
+
+    return out + "\"";
+}
+
+void write_csv(std::ostream &out, const std::vector<Measurement> &results)
+{
+    for (const auto &item : environment())
+    {
+        out << "# " << item.first << "=" << item.second << "\n";
+    }
+
+    out << "kernel,library,schedule,threads,repeats,mean_s,stddev_s,min_s,speedup,efficiency,checksum\n";
+
+    out.precision(6);
+
+    for (const Measurement &m : results)
+    {
+        out << m.kernel << "," << m.library << ",\"" << m.schedule << "\"," << m.threads << ","
+            << m.repeats << "," << m.mean << "," << m.stddev << "," << m.min << ","
+            << m.speedup << "," << m.efficiency << "," << m.checksum << "\n";
+    }
+}
+
+void write_json(std::ostream &out, const std::vector<Measurement> &results)
+{
+    out.precision(6);
+
+    out << "{\n  \"environment\": {";
+
+    const auto env = environment();
+
+    for (size_t i = 0; i < env.size(); i++)
+    {
+        out << (i ? "," : "") << "\n    " << json_string(env[i].first) << ": "
+            << json_string(env[i].second);
+    }
+
+    out << "\n  },\n  \"results\": [";
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Measurement &m = results[i];
+
+        out << (i ? "," : "") << "\n    { \"kernel\": " << json_string(m.kernel)
+            << ", \"library\": " << json_string(m.library)
+            << ", \"schedule\": " << json_string(m.schedule)
+            << ", \"threads\": " << m.threads << ", \"repeats\": " << m.repeats
+            << ", \"mean_s\": " << m.mean << ", \"stddev_s\": " << m.stddev
+            << ", \"min_s\": " << m.min << ", \"speedup\": " << m.speedup
+            << ", \"efficiency\": " << m.efficiency << ", \"checksum\": " << m.checksum << " }";
+    }
+
+    out << "\n  ]\n}\n";
+}
+
+std::vector<int> parse_threads(const std::string &list)
+{
+    std::vector<int> threads;
+    std::stringstream in(list);
+    std::string item;
+
+    while (std::getline(in, item, ','))
+    {
+        threads.push_back(std::stoi(item));
+    }
+
+    return threads;
+}
+
+int main(int argc, char **argv)
+{
+    Config config;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const std::string flag = argv[i];
+        const std::string value = argv[i+1];
+
+        if (flag == "-t") config.threads = parse_threads(value);
+        else if (flag == "-r") config.repeats = std::max(1, std::stoi(value));
+        else if (flag == "-k") config.kernel = value;
+        else if (flag == "-s") config.size_scale = std::stod(value);
+        else if (flag == "-f") config.format = value;
+        else if (flag == "-o") config.output = value;
+        else
+        {
+            std::cerr << "unknown option " << flag << std::endl;
+            return 1;
+        }
+    }
+
+    if (config.threads.empty())
+    {
+        for (int t = 1; t <= omp_get_num_procs(); t++)
+        {
+            config.threads.push_back(t);
+        }
+    }
+
+    // the speedup is measured against one thread, so always run that first
+    config.threads.push_back(1);
+    std::sort(config.threads.begin(), config.threads.end());
+    config.threads.erase( std::unique(config.threads.begin(), config.threads.end()),
+                          config.threads.end() );
+    config.threads.erase( config.threads.begin(),
+                          std::lower_bound(config.threads.begin(), config.threads.end(), 1) );
+
+    std::vector<Measurement> results;
+
+    for (const Kernel &kernel : kernels())
+    {
+        if (!config.kernel.empty() && kernel.name != config.kernel)
+        {
+            continue;
+        }
+
+        const auto schedules = (kernel.library == "openmp") ? openmp_schedules() : tbb_partitioners();
+
+        for (const Schedule &schedule : schedules)
+        {
+            double serial = 0.0;
+
+            for (int nthreads : config.threads)
+            {
+                omp_set_schedule(schedule.kind, schedule.chunk);
+                tbb::global_control control(tbb::global_control::max_allowed_parallelism, nthreads);
+
+                // one untimed run to start the threads and warm the caches
+                double checksum = kernel.run(nthreads, schedule, config.size_scale);
+
+                std::vector<double> times;
+
+                for (int r = 0; r < config.repeats; r++)
+                {
+                    auto start = tbb::tick_count::now();
+                    checksum = kernel.run(nthreads, schedule, config.size_scale);
+                    times.push_back( (tbb::tick_count::now() - start).seconds() );
+                }
+
+                Measurement m;
+                m.kernel = kernel.name;
+                m.library = kernel.library;
+                m.schedule = schedule.name;
+                m.threads = nthreads;
+                m.repeats = config.repeats;
+                m.checksum = checksum;
+
+                m.mean = 0.0;
+                for (double t : times) m.mean += t;
+                m.mean /= times.size();
+
+                m.stddev = 0.0;
+                for (double t : times) m.stddev += (t - m.mean) * (t - m.mean);
+                m.stddev = (times.size() > 1) ? std::sqrt(m.stddev / (times.size() - 1)) : 0.0;
+
+                m.min = *std::min_element(times.begin(), times.end());
+
+                if (nthreads == 1)
+                {
+                    serial = m.mean;
+                }
+
+                m.speedup = serial / m.mean;
+                m.efficiency = m.speedup / nthreads;
+
+                results.push_back(m);
+
+                std::cerr << kernel.name << " [" << schedule.name << "] " << nthreads
+                          << " threads: " << m.mean << " s" << std::endl;
+            }
+        }
+    }
+
+    std::ofstream file;
+
+    if (!config.output.empty())
+    {
+        file.open(config.output);
+    }
+
+    std::ostream &out = config.output.empty() ? std::cout : file;
+
+    if (config.format == "json")
+    {
+        write_json(out, results);
+    }
+    else
+    {
+        write_csv(out, results);
+    }
+
+    return 0;
+}
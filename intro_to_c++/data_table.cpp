@@ -0,0 +1,165 @@
+#include <iostream>
+#include <string>
+#include <map>
+#include <vector>
+#include <chrono>
+
+#include "table.h"
+
+// The database from data.cpp, stored in the columnar Table from table.h
+// rather than in a map of maps. If a CSV file is given (a header line of
+// name,field,field,... then one line per person, with at least weight and
+// height fields), it is loaded as well; otherwise a million made-up
+// people are added, to compare the speed of the map and the table.
+//
+// Compile with g++ -std=c++17 -O3 -march=native data_table.cpp
+// usage: data_table [people.csv]
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void print(const Table &table, size_t max_rows)
+{
+    for (size_t r = 0; r < table.nrows() && r < max_rows; ++r)
+    {
+        // print out the name
+        std::cout << table.key(r) << " : ";
+
+        // now print out all of the data about the person
+        for (int c = 0; c < table.ncolumns(); ++c)
+        {
+            std::cout << table.column_name(c) << "=" << table.at(r, c) << " ";
+        }
+
+        std::cout << std::endl;
+    }
+}
+
+// Fill a map of maps and a table with the same n made-up people, and
+// time calculating everyone's bmi in each
+void compare(size_t n)
+{
+    std::vector<std::string> names(n);
+    std::vector<float> heights(n);
+    std::vector<float> weights(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        names[i] = "person" + std::to_string(i);
+        heights[i] = 1.4f + 0.5f * float(i % 101) / 100;
+        weights[i] = 50.0f + 40.0f * float(i % 97) / 96;
+    }
+
+    std::map< std::string, std::map<std::string, float> > database;
+    Table table;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        database[names[i]]["height"] = heights[i];
+        database[names[i]]["weight"] = weights[i];
+    }
+
+    const double map_fill = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+
+    const int height = table.add_column("height");
+    const int weight = table.add_column("weight");
+    table.reserve(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const size_t r = table.add_row(names[i]);
+        table.at(r, height) = heights[i];
+        table.at(r, weight) = weights[i];
+    }
+
+    const double table_fill = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+
+    double map_sum = 0;
+
+    for (auto &item : database)
+    {
+        auto &data = item.second;
+        data["bmi"] = data["weight"] / (data["height"] * data["height"]);
+        map_sum += data["bmi"];
+    }
+
+    const double map_bmi = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+
+    const int b = table.add_column("bmi");
+    bmi(table.data(weight), table.data(height), table.data(b), table.nrows());
+    const double table_mean = mean(table.data(b), table.nrows());
+
+    const double table_bmi = seconds_since(start);
+
+    std::cout << n << " people, mean bmi " << map_sum / n << " (map), "
+              << table_mean << " (table)" << std::endl;
+    std::cout << "filling:         map " << map_fill << " s, table " << table_fill << " s" << std::endl;
+    std::cout << "calculating bmi: map " << map_bmi << " s, table " << table_bmi << " s" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    Table database;
+
+    // let's first put the data in three vectors
+    std::vector<std::string> names = { "James", "Jane", "Janet", "John" };
+    std::vector<float> heights = { 1.7, 1.8, 1.5, 1.4 };
+    std::vector<float> weights = { 75.4, 76.5, 56.8, 52.0 };
+
+    // now put all of the data into the database
+    const int height = database.add_column("height");
+    const int weight = database.add_column("weight");
+
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        const size_t r = database.add_row(names[i]);
+
+        database.at(r, height) = heights[i];
+        database.at(r, weight) = weights[i];
+    }
+
+    if (argc > 1)
+    {
+        try
+        {
+            auto start = std::chrono::steady_clock::now();
+            const size_t nread = database.load_csv(argv[1]);
+
+            std::cout << "Read " << nread << " people from " << argv[1]
+                      << " in " << seconds_since(start) << " s" << std::endl;
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // Calculate bmi for every person at once, as a new column
+    const int b = database.add_column("bmi");
+    bmi(database.data(database.column("weight")), database.data(database.column("height")),
+        database.data(b), database.nrows());
+
+    // now print out the database (the first 10 people)
+    print(database, 10);
+
+    std::cout << "mean bmi of " << database.nrows() << " people: "
+              << mean(database.data(b), database.nrows()) << std::endl;
+
+    if (argc <= 1)
+    {
+        compare(1000000);
+    }
+
+    return 0;
+}
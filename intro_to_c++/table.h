@@ -0,0 +1,429 @@
+#ifndef table_h
+#define table_h
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <charconv>
+#include <cstring>
+#include <algorithm>
+
+// A columnar replacement for the
+//     std::map< std::string, std::map<std::string, float> >
+// database in data.cpp.
+//
+// In the map, every value lives in its own tree node, and reading one
+// field means two tree lookups, each comparing strings along the way.
+// Here each field is one contiguous std::vector<float> (a column), and a
+// row is just an index into the columns. Row names ("keys") are interned:
+// each one is stored once, packed end to end in a single buffer, and is
+// identified by its number, which is also its row index. Keys are found
+// through an open-addressing hash table, so finding a row is one hash
+// and (usually) one string comparison. Scanning a column, e.g. to
+// calculate everyone's bmi, reads memory in order and vectorises.
+
+// A set of strings, each identified by the order in which it was added
+class StringPool
+{
+public:
+    StringPool() : slots(16, Slot{0, -1}), nused(0)
+    {}
+
+    // Return the id of 's', adding it if it is not already in the pool
+    int intern(std::string_view s)
+    {
+        const uint64_t h = hash(s);
+        size_t i = probe(s, h);
+
+        if (slots[i].id >= 0)
+        {
+            return slots[i].id;
+        }
+
+        const int id = size();
+
+        chars.insert(chars.end(), s.begin(), s.end());
+        ends.push_back(chars.size());
+
+        slots[i] = Slot{h, id};
+        ++nused;
+
+        // keep at least half of the slots empty, so probes stay short
+        if (2 * nused > slots.size())
+        {
+            rehash(2 * slots.size());
+        }
+
+        return id;
+    }
+
+    // Return the id of 's', or -1 if it is not in the pool
+    int find(std::string_view s) const
+    {
+        return slots[probe(s, hash(s))].id;
+    }
+
+    // Return string 'id'. This is only valid until the next string is added
+    std::string_view str(int id) const
+    {
+        const size_t begin = (id > 0) ? ends[id-1] : 0;
+        return std::string_view(chars.data() + begin, ends[id] - begin);
+    }
+
+    int size() const
+    {
+        return int(ends.size());
+    }
+
+    void reserve(size_t nstrings, size_t nchars)
+    {
+        ends.reserve(nstrings);
+        chars.reserve(nchars);
+
+        size_t nslots = slots.size();
+
+        while (nslots < 2 * nstrings)
+        {
+            nslots *= 2;
+        }
+
+        if (nslots > slots.size())
+        {
+            rehash(nslots);
+        }
+    }
+
+private:
+    struct Slot
+    {
+        uint64_t hash;
+        int id;
+    };
+
+    // FNV-1a
+    static uint64_t hash(std::string_view s)
+    {
+        uint64_t h = 14695981039346656037ull;
+
+        for (char c : s)
+        {
+            h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+
+        return h;
+    }
+
+    // Return the slot holding 's', or the empty slot where it would go
+    // (linear probing; the number of slots is a power of two)
+    size_t probe(std::string_view s, uint64_t h) const
+    {
+        const size_t mask = slots.size() - 1;
+        size_t i = h & mask;
+
+        while (slots[i].id >= 0 && (slots[i].hash != h || str(slots[i].id) != s))
+        {
+            i = (i + 1) & mask;
+        }
+
+        return i;
+    }
+
+    void rehash(size_t nslots)
+    {
+        std::vector<Slot> old(nslots, Slot{0, -1});
+        old.swap(slots);
+
+        const size_t mask = slots.size() - 1;
+
+        for (const Slot &slot : old)
+        {
+            if (slot.id >= 0)
+            {
+                size_t i = slot.hash & mask;
+
+                while (slots[i].id >= 0)
+                {
+                    i = (i + 1) & mask;
+                }
+
+                slots[i] = slot;
+            }
+        }
+    }
+
+    std::vector<char> chars;
+    // where each string ends in 'chars' (and the next one begins)
+    std::vector<size_t> ends;
+    std::vector<Slot> slots;
+    size_t nused;
+};
+
+// A table of float fields, with one row per key
+class Table
+{
+public:
+    // The value of fields that have not been set
+    static float missing()
+    {
+        return std::numeric_limits<float>::quiet_NaN();
+    }
+
+    // Return the index of the column called 'name', adding it (with every
+    // value missing) if there is no such column
+    int add_column(std::string_view name)
+    {
+        const int c = names.intern(name);
+
+        if (c == ncolumns())
+        {
+            columns.emplace_back(nrows(), missing());
+        }
+
+        return c;
+    }
+
+    // Return the index of the column called 'name', or -1
+    int column(std::string_view name) const
+    {
+        return names.find(name);
+    }
+
+    // Return the row for 'key', adding it (with every value missing) if
+    // there is no such row
+    size_t add_row(std::string_view key)
+    {
+        const size_t r = keys.intern(key);
+
+        if (r == nrows())
+        {
+            for (auto &values : columns)
+            {
+                values.push_back(missing());
+            }
+
+            ++n;
+        }
+
+        return r;
+    }
+
+    // Return the row for 'key', or -1
+    long row(std::string_view key) const
+    {
+        return keys.find(key);
+    }
+
+    std::string_view key(size_t r) const
+    {
+        return keys.str(int(r));
+    }
+
+    std::string_view column_name(int c) const
+    {
+        return names.str(c);
+    }
+
+    float& at(size_t r, int c)
+    {
+        return columns[c][r];
+    }
+
+    float at(size_t r, int c) const
+    {
+        return columns[c][r];
+    }
+
+    // Return the nrows() values of column 'c', in row order
+    float* data(int c)
+    {
+        return columns[c].data();
+    }
+
+    const float* data(int c) const
+    {
+        return columns[c].data();
+    }
+
+    size_t nrows() const
+    {
+        return n;
+    }
+
+    int ncolumns() const
+    {
+        return int(columns.size());
+    }
+
+    // Make room for 'nrows' rows whose keys total about 'nchars' characters
+    void reserve(size_t nrows, size_t nchars = 0)
+    {
+        keys.reserve(nrows, nchars);
+
+        for (auto &values : columns)
+        {
+            values.reserve(nrows);
+        }
+    }
+
+    // Load rows from a CSV file. The first line is the header: the name of
+    // the key column followed by the names of the fields. Every other line
+    // is a key followed by its values (an empty value is missing). Fields
+    // and rows that are not yet in the table are added, and the values of
+    // rows that are already there are overwritten. Returns the number of
+    // lines of data read
+    size_t load_csv(const std::string &filename);
+
+private:
+    StringPool keys;
+    StringPool names;
+    std::vector< std::vector<float> > columns;
+    size_t n = 0;
+};
+
+// Column kernels: each works on whole columns, so the loops run over
+// contiguous memory and the compiler can vectorise them
+
+// out[i] = weight[i] / (height[i] * height[i])
+inline void bmi(const float *weight, const float *height, float *out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        out[i] = weight[i] / (height[i] * height[i]);
+    }
+}
+
+// Return the mean of the values in a column that are not missing
+inline double mean(const float *values, size_t n)
+{
+    double sum = 0;
+    size_t count = 0;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        const bool present = !std::isnan(values[i]);
+        sum += present ? values[i] : 0.0;
+        count += present;
+    }
+
+    return (count > 0) ? sum / count : std::nan("");
+}
+
+inline size_t Table::load_csv(const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+
+    if (!file)
+    {
+        throw std::runtime_error("Cannot open " + filename);
+    }
+
+    // read the whole file at once, and parse it in place
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    const std::string text = buffer.str();
+
+    const char *p = text.data();
+    const char *end = p + text.size();
+
+    auto next_line = [&](std::string_view &line)
+    {
+        if (p >= end)
+        {
+            return false;
+        }
+
+        const char *eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        eol = eol ? eol : end;
+
+        line = std::string_view(p, eol - p);
+
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.remove_suffix(1);
+        }
+
+        p = eol + 1;
+        return true;
+    };
+
+    auto next_field = [](std::string_view &line)
+    {
+        const size_t comma = line.find(',');
+        std::string_view field = line.substr(0, comma);
+        line = (comma == std::string_view::npos) ? std::string_view() : line.substr(comma + 1);
+        return field;
+    };
+
+    std::string_view line;
+
+    if (!next_line(line))
+    {
+        throw std::runtime_error(filename + " is empty");
+    }
+
+    // the header: skip the key column's name, and find the field columns
+    next_field(line);
+
+    std::vector<int> fields;
+
+    while (!line.empty())
+    {
+        fields.push_back(add_column(next_field(line)));
+    }
+
+    // one row per line, so count the lines to reserve space up front
+    const size_t nlines = std::count(p, end, '\n') + 1;
+    reserve(nrows() + nlines, end - p);
+
+    size_t nread = 0;
+    size_t lineno = 1;
+
+    while (next_line(line))
+    {
+        ++lineno;
+
+        if (line.empty())
+        {
+            continue;
+        }
+
+        const size_t r = add_row(next_field(line));
+
+        for (int c : fields)
+        {
+            const std::string_view field = next_field(line);
+
+            float value = missing();
+
+            if (!field.empty())
+            {
+                auto result = std::from_chars(field.data(), field.data() + field.size(), value);
+
+                if (result.ec != std::errc() || result.ptr != field.data() + field.size())
+                {
+                    throw std::runtime_error(filename + ":" + std::to_string(lineno) +
+                                             ": cannot read '" + std::string(field) + "' as a number");
+                }
+            }
+
+            at(r, c) = value;
+        }
+
+        if (!line.empty())
+        {
+            throw std::runtime_error(filename + ":" + std::to_string(lineno) + ": too many values");
+        }
+
+        ++nread;
+    }
+
+    return nread;
+}
+
+#endif
@@ -0,0 +1,47 @@
+#include "part1.h"
+#include "filecounter.h"
+
+using namespace part1;
+using namespace filecounter;
+
+size_t sum(size_t x, size_t y)
+{
+  return x + y;
+}
+
+int main(int argc, char **argv) // gives you access to command line arguments
+{
+  // usage: countlines_pipeline [-b buffer_kb] [-m budget_mb] file1 file2 ...
+  size_t buffer_size = 1024 * 1024;
+  size_t buffer_budget = 64 * 1024 * 1024;
+
+  auto args = get_arguments(argc, argv);
+  std::vector<std::string> filenames;
+
+  for (size_t i = 0; i < args.size(); i++)
+  {
+    if (args[i] == "-b" && i+1 < args.size())
+    {
+      buffer_size = std::stoul(args[++i]) * 1024;
+    }
+    else if (args[i] == "-m" && i+1 < args.size())
+    {
+      buffer_budget = std::stoul(args[++i]) * 1024 * 1024;
+    }
+    else
+    {
+      filenames.push_back(args[i]);
+    }
+  }
+
+  auto results = count_lines_pipelined(filenames, buffer_size, buffer_budget);
+
+  for (int i = 0; i < filenames.size(); i++)
+  {
+    std::cout << filenames[i] << " has " << results[i] << " lines." << std::endl;
+  }
+
+  std::cout << "Total number of lines: " << reduce(sum, results) << std::endl;
+
+  return 0;
+}
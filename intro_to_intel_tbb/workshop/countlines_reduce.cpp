@@ -1,18 +1,48 @@
 #include "part1.h"
 #include "filecounter.h"
+#include "countcache.h"
 
 using namespace part1;
 using namespace filecounter;
 
-int sum(int x, int y)
+size_t sum(size_t x, size_t y)
 {
   return x + y;
 }
 
 int main(int argc, char **argv) // gives you access to command line arguments
 {
-  auto filenames = get_arguments(argc, argv);
-  auto results = map(count_lines, filenames);
+  // usage: countlines_reduce [-c cache_file] file1 file2 ...
+  //
+  // Directories are searched for files recursively. With -c, only files
+  // that are new or have changed since the last run are counted; the
+  // rest are taken from cache_file
+  auto args = get_arguments(argc, argv);
+  const bool use_cache = args.size() >= 2 && args[0] == "-c";
+
+  std::vector<std::string> paths(args.begin() + (use_cache ? 2 : 0), args.end());
+  auto files = find_files(paths);
+  std::vector<size_t> results;
+
+  if (use_cache)
+  {
+    CountCache cache(args[1]);
+
+    results = count_lines_incremental(files, cache, paths);
+    cache.save(args[1]);
+  }
+  else
+  {
+    std::vector<std::string> filenames;
+
+    for (const auto &file : files)
+    {
+      filenames.push_back(file.path);
+    }
+
+    results = map(count_lines, filenames);
+  }
+
   auto total = reduce(sum, results);
   
   std::cout << "Total number of lines: " << total << std::endl;
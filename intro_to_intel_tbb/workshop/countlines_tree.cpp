@@ -0,0 +1,69 @@
+#include "part1.h"
+#include "filetree.h"
+#include "countcache.h"
+
+using namespace part1;
+using namespace filecounter;
+
+size_t sum(size_t x, size_t y)
+{
+  return x + y;
+}
+
+int main(int argc, char **argv) // gives you access to command line arguments
+{
+  // usage: countlines_tree [-p pattern ...] [-c cache_file] path1 path2 ...
+  // e.g. countlines_tree -p '*.txt' -p '*.log' -c logs.cache /var/log
+  //
+  // With -c, the count of every file is saved in cache_file, and the
+  // next run only reads the files that are new or have changed
+  std::vector<std::string> paths;
+  std::vector<std::string> patterns;
+  std::string cache_file;
+
+  auto args = get_arguments(argc, argv);
+
+  for (int i = 0; i < args.size(); i++)
+  {
+    if (args[i] == "-p" && i+1 < args.size())
+    {
+      patterns.push_back(args[++i]);
+    }
+    else if (args[i] == "-c" && i+1 < args.size())
+    {
+      cache_file = args[++i];
+    }
+    else
+    {
+      paths.push_back(args[i]);
+    }
+  }
+
+  auto files = find_files(paths, patterns);
+  std::vector<size_t> results;
+
+  if (cache_file.empty())
+  {
+    results = count_lines_scheduled(files);
+  }
+  else
+  {
+    CountCache cache(cache_file);
+    size_t nrecounted = 0;
+
+    results = count_lines_incremental(files, cache, paths, patterns, &nrecounted);
+    cache.save(cache_file);
+
+    std::cout << "Counted " << nrecounted << " of " << files.size()
+              << " files (the rest were unchanged)." << std::endl;
+  }
+
+  for (int i = 0; i < files.size(); i++)
+  {
+    std::cout << files[i].path << " has " << results[i] << " lines." << std::endl;
+  }
+
+  std::cout << "Total number of lines: " << reduce(sum, results) << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,143 @@
+#ifndef arena_h
+#define arena_h
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <algorithm>
+
+namespace part1
+{
+
+/** This is a simple monotonic memory arena. Memory is handed out
+    from large blocks by bumping an offset, and individual frees are
+    ignored. Calling 'reset' makes all of the memory available again
+    without returning it to the system, so an arena can be reused
+    across the iterations of a loop without any further allocations.
+    An Arena is not thread-safe */
+class Arena
+{
+public:
+    explicit Arena(size_t _block_size=1<<20)
+        : block_size(_block_size), current(0), offset(0)
+    {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment=alignof(std::max_align_t))
+    {
+        while (current < blocks.size())
+        {
+            void *ptr = take(current, bytes, alignment);
+
+            if (ptr)
+            {
+                return ptr;
+            }
+
+            current += 1;
+            offset = 0;
+        }
+
+        // no room left, so add a block that is big enough
+        const size_t size = std::max(block_size, bytes + alignment);
+        blocks.push_back( Block{ std::unique_ptr<char[]>(new char[size]), size } );
+        current = blocks.size() - 1;
+        offset = 0;
+
+        return take(current, bytes, alignment);
+    }
+
+    /** Make all of the arena's memory available for reuse. Anything
+        previously allocated from the arena must no longer be used */
+    void reset()
+    {
+        current = 0;
+        offset = 0;
+    }
+
+    /** Return the total number of bytes held by the arena */
+    size_t capacity() const
+    {
+        size_t total = 0;
+
+        for (const Block &block : blocks)
+        {
+            total += block.size;
+        }
+
+        return total;
+    }
+
+private:
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    void* take(size_t i, size_t bytes, size_t alignment)
+    {
+        const uintptr_t base = reinterpret_cast<uintptr_t>(blocks[i].data.get());
+        const uintptr_t start = (base + offset + alignment - 1) & ~uintptr_t(alignment - 1);
+
+        if (start + bytes > base + blocks[i].size)
+        {
+            return nullptr;
+        }
+
+        offset = (start + bytes) - base;
+
+        return reinterpret_cast<void*>(start);
+    }
+
+    std::vector<Block> blocks;
+    size_t block_size;
+    size_t current;
+    size_t offset;
+};
+
+/** This is a standard allocator that takes its memory from an Arena,
+    e.g. std::vector<float, ArenaAllocator<float>> */
+template<class T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    ArenaAllocator(Arena &_arena) : arena(&_arena)
+    {}
+
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena)
+    {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>( arena->allocate(n * sizeof(T), alignof(T)) );
+    }
+
+    void deallocate(T*, size_t)
+    {}
+
+    template<class U>
+    bool operator==(const ArenaAllocator<U> &other) const
+    {
+        return arena == other.arena;
+    }
+
+    template<class U>
+    bool operator!=(const ArenaAllocator<U> &other) const
+    {
+        return arena != other.arena;
+    }
+
+    Arena *arena;
+};
+
+} // end of namespace part1
+
+#endif
@@ -0,0 +1,245 @@
+#ifndef countcache_h
+#define countcache_h
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <cstdio>
+
+#include "filetree.h"
+#include "lineindex.h"
+
+#ifdef FILECOUNTER_HAVE_MMAP
+
+namespace filecounter
+{
+
+/** This remembers the number of lines in each file that has been counted,
+    together with the stamp (size, modification time and inode) of the
+    file when it was counted. A file whose stamp has not changed does
+    not need to be counted again.
+
+    The cache is saved as a text file with a header line followed by one
+    line per file: "size mtime_sec mtime_nsec inode nlines path" */
+class CountCache
+{
+public:
+    struct Entry
+    {
+        FileStamp stamp;
+        size_t nlines;
+    };
+
+    CountCache()
+    {}
+
+    /** Load the cache from 'filename'. A missing or unreadable cache
+        is treated as empty, so every file will be counted */
+    explicit CountCache(const std::string &filename)
+    {
+        std::ifstream in( filename );
+        std::string line;
+
+        if (!std::getline(in, line) || line != "countcache 1")
+        {
+            return;
+        }
+
+        while (std::getline(in, line))
+        {
+            std::istringstream fields(line);
+            Entry entry;
+
+            fields >> entry.stamp.size >> entry.stamp.mtime_sec >> entry.stamp.mtime_nsec
+                   >> entry.stamp.inode >> entry.nlines;
+
+            // the path is the rest of the line, so may contain spaces
+            std::string path;
+
+            if (fields.get() == ' ' && std::getline(fields, path) && !path.empty())
+            {
+                entries[path] = entry;
+            }
+        }
+    }
+
+    /** Return true (and set 'nlines') if 'path' is in the cache and
+        has not changed since it was counted */
+    bool lookup(const std::string &path, const FileStamp &stamp, size_t &nlines) const
+    {
+        auto it = entries.find(path);
+
+        if (it == entries.end() || it->second.stamp != stamp)
+        {
+            return false;
+        }
+
+        nlines = it->second.nlines;
+        return true;
+    }
+
+    void update(const std::string &path, const FileStamp &stamp, size_t nlines)
+    {
+        entries[path] = Entry{ stamp, nlines };
+    }
+
+    /** Remove the files that find_files(roots, patterns) would have
+        found, but that are not in 'files' (its result), e.g. files that
+        have been deleted since the last count. Files outside of 'roots',
+        or that do not match 'patterns', are left alone, so one cache can
+        be shared between runs over different trees */
+    void retain(const std::vector<FileInfo> &files, const std::vector<std::string> &roots,
+                const std::vector<std::string> &patterns={})
+    {
+        std::unordered_map<std::string, bool> found;
+
+        for (const FileInfo &file : files)
+        {
+            found[file.path] = true;
+        }
+
+        for (auto it = entries.begin(); it != entries.end(); )
+        {
+            if (!found.count(it->first) && in_scan(it->first, roots, patterns))
+            {
+                it = entries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    /** Write the cache to 'filename'. The cache is written to a temporary
+        file that is then renamed, so an interrupted run never leaves a
+        half-written cache. Returns false if it could not be written */
+    bool save(const std::string &filename) const
+    {
+        std::ofstream out( filename + ".tmp" );
+
+        if (!out)
+        {
+            return false;
+        }
+
+        out << "countcache 1\n";
+
+        for (const auto &item : entries)
+        {
+            const Entry &entry = item.second;
+
+            out << entry.stamp.size << " " << entry.stamp.mtime_sec << " "
+                << entry.stamp.mtime_nsec << " " << entry.stamp.inode << " "
+                << entry.nlines << " " << item.first << "\n";
+        }
+
+        out.close();
+
+        if (!out)
+        {
+            std::remove( (filename + ".tmp").c_str() );
+            return false;
+        }
+
+        return std::rename( (filename + ".tmp").c_str(), filename.c_str() ) == 0;
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+private:
+    /** Return whether 'path' would be looked at by find_files(roots, patterns):
+        it is one of the roots, or it is below one (find_files joins paths
+        with '/') and its name matches one of the patterns */
+    static bool in_scan(const std::string &path, const std::vector<std::string> &roots,
+                        const std::vector<std::string> &patterns)
+    {
+        const std::string name = path.substr(path.rfind('/') + 1);
+
+        for (const std::string &root : roots)
+        {
+            if (path == root)
+            {
+                return true;
+            }
+
+            if (path.size() > root.size() + 1 && path.compare(0, root.size(), root) == 0 &&
+                path[root.size()] == '/' && detail::matches_any(name, patterns))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    std::unordered_map<std::string, Entry> entries;
+};
+
+/** Count the lines in every file in 'files', which is the result of
+    find_files(roots, patterns), returning the counts in the same order.
+    Files that are unchanged since they were put into 'cache' are not read
+    at all; only new and changed files are counted (using
+    count_lines_scheduled), and their counts are stored in 'cache'. Cached
+    files under 'roots' that are no longer found are removed from the
+    cache (see CountCache::retain). If 'nrecounted' is not null it is set
+    to the number of files that had to be counted */
+inline std::vector<size_t> count_lines_incremental(const std::vector<FileInfo> &files,
+                                                   CountCache &cache,
+                                                   const std::vector<std::string> &roots,
+                                                   const std::vector<std::string> &patterns={},
+                                                   size_t *nrecounted=nullptr)
+{
+    std::vector<size_t> nlines(files.size(), 0);
+    std::vector<FileStamp> stamps(files.size());
+
+    std::vector<FileInfo> changed;
+    std::vector<size_t> changed_index;
+
+    for (size_t i=0; i<files.size(); ++i)
+    {
+        stamps[i] = LineIndex::stamp_of(files[i].path);
+
+        if (!cache.lookup(files[i].path, stamps[i], nlines[i]))
+        {
+            changed.push_back( FileInfo{ files[i].path, size_t(stamps[i].size) } );
+            changed_index.push_back(i);
+        }
+    }
+
+    const std::vector<size_t> counts = count_lines_scheduled(changed);
+
+    for (size_t j=0; j<changed.size(); ++j)
+    {
+        const size_t i = changed_index[j];
+        nlines[i] = counts[j];
+
+        // a file that changed while it was being counted gets a new
+        // stamp, so is counted again next time rather than trusted
+        if (LineIndex::stamp_of(files[i].path) == stamps[i])
+        {
+            cache.update(files[i].path, stamps[i], counts[j]);
+        }
+    }
+
+    cache.retain(files, roots, patterns);
+
+    if (nrecounted)
+    {
+        *nrecounted = changed.size();
+    }
+
+    return nlines;
+}
+
+} // end of namespace filecounter
+
+#endif // FILECOUNTER_HAVE_MMAP
+
+#endif
@@ -7,21 +7,394 @@
 #include <cmath>
 #include <string>
 #include <fstream>
+#include <algorithm>
+#include <cstdint>
+
+#include <tbb/parallel_reduce.h>
+#include <tbb/blocked_range.h>
+#include <tbb/partitioner.h>
+#include <tbb/parallel_pipeline.h>
+#include <tbb/concurrent_queue.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define FILECOUNTER_HAVE_MMAP 1
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 namespace filecounter
 {
 
-/** This function counts the number of lines in the file called 'filename' */
-int count_lines(const std::string &filename)
+/** These control when and how a single file is counted in parallel */
+struct CountOptions
+{
+    /** Files at least this big are split into chunks that are
+        counted concurrently. Smaller files are counted serially */
+    size_t parallel_threshold = 64 * 1024 * 1024;
+
+    /** The maximum number of bytes counted by one task */
+    size_t chunk_size = 4 * 1024 * 1024;
+};
+
+/** Return the options used by count_lines. Change these before
+    counting starts, e.g. count_options().chunk_size = 1 << 20; */
+inline CountOptions& count_options()
+{
+    static CountOptions options;
+    return options;
+}
+
+namespace detail
+{
+    /** Files smaller than this are read into a buffer rather than mapped,
+        as setting up the mapping costs more than the copy */
+    const size_t mmap_threshold = 64 * 1024;
+
+    /** Size of the buffer used when reading files that are not mapped */
+    const size_t read_buffer_size = 1024 * 1024;
+
+    /** Count the number of '\n' characters in the 'n' bytes at 'data'.
+        Each block of bytes is compared against '\n' at once, and the
+        matches are accumulated in per-byte counters that are summed
+        with a SAD instruction before they can overflow */
+    inline size_t count_newlines(const char *data, size_t n)
+    {
+        size_t count = 0;
+        size_t i = 0;
+
+#if defined(__AVX2__)
+        const __m256i newline = _mm256_set1_epi8('\n');
+        const __m256i zero = _mm256_setzero_si256();
+
+        while (i + 32 <= n)
+        {
+            __m256i acc = _mm256_setzero_si256();
+            const size_t nblocks = std::min<size_t>(255, (n - i) / 32);
+
+            for (size_t b=0; b<nblocks; ++b, i+=32)
+            {
+                const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+                acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, newline));
+            }
+
+            const __m256i sums = _mm256_sad_epu8(acc, zero);
+            count += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1)
+                   + _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+        }
+#elif defined(__SSE2__)
+        const __m128i newline = _mm_set1_epi8('\n');
+        const __m128i zero = _mm_setzero_si128();
+
+        while (i + 16 <= n)
+        {
+            __m128i acc = _mm_setzero_si128();
+            const size_t nblocks = std::min<size_t>(255, (n - i) / 16);
+
+            for (size_t b=0; b<nblocks; ++b, i+=16)
+            {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, newline));
+            }
+
+            const __m128i sums = _mm_sad_epu8(acc, zero);
+            count += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+        }
+#endif
+
+        count += std::count(data + i, data + n, '\n');
+
+        return count;
+    }
+
+    /** Call 'func' with the position of every '\n' character in the 'n'
+        bytes at 'data', in order. Blocks of bytes are compared at once,
+        and the positions are read from the resulting bit mask */
+    template<class FUNC>
+    void for_each_newline(const char *data, size_t n, FUNC func)
+    {
+        size_t i = 0;
+
+#if defined(__SSE2__) && defined(__GNUC__)
+        const __m128i newline = _mm_set1_epi8('\n');
+
+        for (; i + 16 <= n; i += 16)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, newline));
+
+            while (mask)
+            {
+                func(i + __builtin_ctz(mask));
+                mask &= mask - 1;
+            }
+        }
+#endif
+
+        for (; i < n; ++i)
+        {
+            if (data[i] == '\n')
+            {
+                func(i);
+            }
+        }
+    }
+
+    /** Return the number of lines in 'n' bytes of text, counting a last
+        line without a final newline as std::getline would */
+    inline size_t lines_in_buffer(const char *data, size_t n)
+    {
+        if (n == 0)
+        {
+            return 0;
+        }
+
+        return count_newlines(data, n) + (data[n-1] != '\n' ? 1 : 0);
+    }
+
+    /** Count lines by reading the file through a fixed-size buffer. This
+        works for anything that can be opened, including pipes */
+    inline size_t count_lines_buffered(const std::string &filename)
+    {
+        std::ifstream file( filename, std::ios::binary );
+
+        std::vector<char> buffer(read_buffer_size);
+
+        size_t nlines = 0;
+        char last = '\n';
+
+        while (file)
+        {
+            file.read(buffer.data(), buffer.size());
+            const size_t n = file.gcount();
+
+            if (n == 0)
+            {
+                break;
+            }
+
+            nlines += count_newlines(buffer.data(), n);
+            last = buffer[n-1];
+        }
+
+        return nlines + (last != '\n' ? 1 : 0);
+    }
+
+    /** Count the '\n' characters in the 'n' bytes at 'data' by splitting
+        them into chunks of at most 'chunk_size' bytes, which are counted
+        concurrently using tbb::parallel_reduce */
+    inline size_t count_newlines_parallel(const char *data, size_t n, size_t chunk_size)
+    {
+        chunk_size = std::max<size_t>(chunk_size, 4096);
+
+        return tbb::parallel_reduce( tbb::blocked_range<size_t>(0, n, chunk_size),
+                                     size_t(0),
+               [&](const tbb::blocked_range<size_t> &r, size_t running_total)
+        {
+            return running_total + count_newlines(data + r.begin(), r.size());
+        }, std::plus<size_t>(), tbb::simple_partitioner() );
+    }
+
+#ifdef FILECOUNTER_HAVE_MMAP
+    /** This is a read-only memory mapping of a whole file. 'data' is
+        null if the file could not be mapped */
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::string &filename)
+            : data(nullptr), size(0)
+        {
+            const int fd = ::open(filename.c_str(), O_RDONLY);
+
+            if (fd < 0)
+            {
+                return;
+            }
+
+            struct stat st;
+
+            if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+            {
+                void *ptr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+                if (ptr != MAP_FAILED)
+                {
+                    ::madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+                    data = static_cast<const char*>(ptr);
+                    size = st.st_size;
+                }
+            }
+
+            ::close(fd);
+        }
+
+        ~MappedFile()
+        {
+            if (data)
+            {
+                ::munmap(const_cast<char*>(data), size);
+            }
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char *data;
+        size_t size;
+    };
+
+    /** Return the size of 'filename' if it is a regular file, else 0 */
+    inline size_t regular_file_size(const std::string &filename)
+    {
+        struct stat st;
+
+        if (::stat(filename.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+        {
+            return st.st_size;
+        }
+
+        return 0;
+    }
+#endif
+}
+
+/** This function counts the number of lines in the file called 'filename'.
+    Large regular files are memory-mapped, while small files and pipes
+    are read through a buffer. Files of at least count_options().parallel_threshold
+    bytes are counted in parallel, in chunks of count_options().chunk_size bytes.
+    A final line without a newline is counted, as with std::getline.
+    A file that cannot be opened has 0 lines */
+size_t count_lines(const std::string &filename)
+{
+#ifdef FILECOUNTER_HAVE_MMAP
+    if (detail::regular_file_size(filename) >= detail::mmap_threshold)
+    {
+        detail::MappedFile file( filename );
+
+        if (file.data)
+        {
+            const CountOptions &options = count_options();
+
+            if (file.size < options.parallel_threshold)
+            {
+                return detail::lines_in_buffer(file.data, file.size);
+            }
+
+            const size_t nnewlines = detail::count_newlines_parallel(file.data, file.size,
+                                                                     options.chunk_size);
+
+            return nnewlines + (file.data[file.size-1] != '\n' ? 1 : 0);
+        }
+    }
+#endif
+
+    return detail::count_lines_buffered(filename);
+}
+
+/** This function counts the number of lines in each of the passed files
+    using a three-stage tbb::parallel_pipeline. A serial reader fills
+    buffers of 'buffer_size' bytes from the files in order, the buffers
+    are counted in parallel, and a serial in-order stage adds each count
+    to its file's total. While one buffer is being counted the next ones
+    are already being read, so disk and CPU work overlap. At most
+    'buffer_budget' bytes of buffers exist at any time */
+inline std::vector<size_t> count_lines_pipelined(const std::vector<std::string> &filenames,
+                                                 size_t buffer_size=1024*1024,
+                                                 size_t buffer_budget=64*1024*1024)
 {
-    std::ifstream file( filename );
+    struct Buffer
+    {
+        std::vector<char> data;
+        size_t nbytes;
+        size_t file;
+        size_t nnewlines;
+    };
 
-    int nlines = 0;
+    buffer_size = std::max<size_t>(buffer_size, 4096);
+    const size_t nbuffers = std::max<size_t>(1, buffer_budget / buffer_size);
 
-    std::string str;
-    while (std::getline(file, str))
+    std::vector<Buffer> buffers(nbuffers);
+    tbb::concurrent_bounded_queue<Buffer*> free_buffers;
+
+    for (Buffer &buffer : buffers)
     {
-        nlines += 1;
+        buffer.data.resize(buffer_size);
+        free_buffers.push(&buffer);
+    }
+
+    std::vector<size_t> nlines(filenames.size(), 0);
+    std::vector<char> last(filenames.size(), '\n');
+
+    size_t current = 0;
+    std::ifstream file;
+
+    if (!filenames.empty())
+    {
+        file.open(filenames[0], std::ios::binary);
+    }
+
+    tbb::parallel_pipeline( nbuffers,
+
+        tbb::make_filter<void,Buffer*>( tbb::filter_mode::serial_in_order,
+            [&](tbb::flow_control &fc) -> Buffer*
+        {
+            while (current < filenames.size())
+            {
+                Buffer *buffer = nullptr;
+
+                // the number of tokens is the number of buffers, so one is
+                // always free, but wait rather than rely on it
+                free_buffers.pop(buffer);
+
+                file.read(buffer->data.data(), buffer_size);
+                buffer->nbytes = file.gcount();
+                buffer->file = current;
+
+                if (buffer->nbytes > 0)
+                {
+                    return buffer;
+                }
+
+                free_buffers.push(buffer);
+
+                file.close();
+                file.clear();
+                current += 1;
+
+                if (current < filenames.size())
+                {
+                    file.open(filenames[current], std::ios::binary);
+                }
+            }
+
+            fc.stop();
+            return nullptr;
+        }) &
+
+        tbb::make_filter<Buffer*,Buffer*>( tbb::filter_mode::parallel,
+            [](Buffer *buffer) -> Buffer*
+        {
+            buffer->nnewlines = detail::count_newlines(buffer->data.data(), buffer->nbytes);
+            return buffer;
+        }) &
+
+        tbb::make_filter<Buffer*,void>( tbb::filter_mode::serial_in_order,
+            [&](Buffer *buffer)
+        {
+            nlines[buffer->file] += buffer->nnewlines;
+            last[buffer->file] = buffer->data[buffer->nbytes - 1];
+            free_buffers.push(buffer);
+        })
+    );
+
+    for (size_t i=0; i<filenames.size(); ++i)
+    {
+        nlines[i] += (last[i] != '\n' ? 1 : 0);
     }
 
     return nlines;
@@ -48,4 +421,3 @@ std::vector<std::string> get_arguments(int argc, char **argv)
 } // end of namespace filecounter
 
 #endif
-
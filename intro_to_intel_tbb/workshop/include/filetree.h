@@ -0,0 +1,182 @@
+#ifndef filetree_h
+#define filetree_h
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <numeric>
+#include <atomic>
+
+#include <tbb/task_group.h>
+#include <tbb/task_arena.h>
+
+#include "filecounter.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+namespace filecounter
+{
+
+/** A file found while walking a directory tree */
+struct FileInfo
+{
+    std::string path;
+    size_t size;
+};
+
+namespace detail
+{
+    inline bool matches_any(const std::string &name, const std::vector<std::string> &patterns)
+    {
+        if (patterns.empty())
+        {
+            return true;
+        }
+
+        for (const std::string &pattern : patterns)
+        {
+            if (::fnmatch(pattern.c_str(), name.c_str(), 0) == 0)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    inline void walk(const std::string &path, const std::vector<std::string> &patterns,
+                     std::vector<FileInfo> &files)
+    {
+        DIR *dir = ::opendir(path.c_str());
+
+        if (!dir)
+        {
+            return;
+        }
+
+        while (struct dirent *entry = ::readdir(dir))
+        {
+            const std::string name = entry->d_name;
+
+            if (name == "." || name == "..")
+            {
+                continue;
+            }
+
+            const std::string child = path + "/" + name;
+
+            // lstat, so that symbolic links to directories are not
+            // followed (and cannot create cycles)
+            struct stat st;
+
+            if (::lstat(child.c_str(), &st) != 0)
+            {
+                continue;
+            }
+
+            if (S_ISDIR(st.st_mode))
+            {
+                walk(child, patterns, files);
+            }
+            else if (matches_any(name, patterns))
+            {
+                // links to files are counted as the file they point to
+                if (S_ISLNK(st.st_mode) && (::stat(child.c_str(), &st) != 0 || !S_ISREG(st.st_mode)))
+                {
+                    continue;
+                }
+
+                if (S_ISREG(st.st_mode))
+                {
+                    files.push_back( FileInfo{ child, size_t(st.st_size) } );
+                }
+            }
+        }
+
+        ::closedir(dir);
+    }
+}
+
+/** Return every regular file under each of 'paths' whose name matches
+    one of the glob 'patterns' (e.g. "*.txt"), or every file if there are
+    no patterns. Directories are searched recursively, while paths that
+    are files are always included */
+inline std::vector<FileInfo> find_files(const std::vector<std::string> &paths,
+                                        const std::vector<std::string> &patterns={})
+{
+    std::vector<FileInfo> files;
+
+    for (const std::string &path : paths)
+    {
+        struct stat st;
+
+        if (::stat(path.c_str(), &st) != 0)
+        {
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode))
+        {
+            detail::walk(path, patterns, files);
+        }
+        else
+        {
+            files.push_back( FileInfo{ path, size_t(st.st_size) } );
+        }
+    }
+
+    return files;
+}
+
+/** Count the lines in every file in 'files', returning the counts in the
+    same order. The files are handed out largest first: one task per worker
+    in a tbb::task_group repeatedly takes the largest file not yet started,
+    so a big file is never left until the end. A big file is itself counted
+    in chunks (see count_options), and idle workers steal those chunks, so
+    the last large file does not run on a single core */
+inline std::vector<size_t> count_lines_scheduled(const std::vector<FileInfo> &files)
+{
+    std::vector<size_t> order(files.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        return files[a].size > files[b].size;
+    });
+
+    std::vector<size_t> nlines(files.size(), 0);
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]()
+    {
+        size_t i;
+
+        while ((i = next.fetch_add(1)) < order.size())
+        {
+            nlines[order[i]] = count_lines(files[order[i]].path);
+        }
+    };
+
+    tbb::task_group group;
+
+    const int nworkers = tbb::this_task_arena::max_concurrency();
+
+    for (int i=0; i<nworkers; ++i)
+    {
+        group.run(worker);
+    }
+
+    group.wait();
+
+    return nlines;
+}
+
+} // end of namespace filecounter
+
+#endif
+
+#endif
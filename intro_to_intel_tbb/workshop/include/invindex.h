@@ -0,0 +1,525 @@
+#ifndef invindex_h
+#define invindex_h
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+
+#include "wordcount.h"
+
+#ifdef FILECOUNTER_HAVE_MMAP
+
+namespace invindex
+{
+
+/** A match of a search: the document (file) and 1-based line number */
+struct Hit
+{
+    uint32_t doc;
+    uint32_t line;
+
+    bool operator==(const Hit &other) const
+    {
+        return doc == other.doc && line == other.line;
+    }
+};
+
+namespace detail
+{
+    /** One occurrence of a word: the word's position (counted in words)
+        within its document, and the line it is on */
+    struct Occurrence
+    {
+        uint64_t pos;
+        uint32_t line;
+    };
+
+    /** Postings are searched as 64-bit keys of (doc << 40 | position),
+        so that the word after key k in the same document is at k + 1 */
+    const int doc_shift = 40;
+
+    inline uint64_t make_key(uint64_t doc, uint64_t pos)
+    {
+        return (doc << doc_shift) | pos;
+    }
+
+    inline void put_varint(std::string &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(char(value | 0x80));
+            value >>= 7;
+        }
+
+        out.push_back(char(value));
+    }
+
+    inline uint64_t get_varint(const uint8_t *&p)
+    {
+        uint64_t value = 0;
+        int shift = 0;
+
+        while (*p & 0x80)
+        {
+            value |= uint64_t(*p++ & 0x7F) << shift;
+            shift += 7;
+        }
+
+        value |= uint64_t(*p++) << shift;
+
+        return value;
+    }
+
+    /** Decode 'count' postings into sorted keys and the matching lines.
+        Every posting is three varints: the gap to its document (0 if the
+        same as the previous posting), and the gaps in position and line
+        from the previous posting in that document */
+    inline void decode(const uint8_t *p, uint32_t count,
+                       std::vector<uint64_t> &keys, std::vector<uint32_t> *lines)
+    {
+        keys.resize(count);
+
+        if (lines)
+        {
+            lines->resize(count);
+        }
+
+        uint64_t doc = 0;
+        uint64_t pos = 0;
+        uint64_t line = 0;
+
+        for (uint32_t i=0; i<count; ++i)
+        {
+            const uint64_t doc_gap = get_varint(p);
+
+            if (doc_gap != 0)
+            {
+                doc += doc_gap;
+                pos = 0;
+                line = 0;
+            }
+
+            pos += get_varint(p);
+            line += get_varint(p);
+
+            keys[i] = make_key(doc, pos);
+
+            if (lines)
+            {
+                (*lines)[i] = uint32_t(line);
+            }
+        }
+    }
+
+    /** Return the index of the first key at or after 'lo' that is >= 'target'.
+        The step doubles until it passes the target, then a binary search
+        finishes the job, so skipping far ahead is cheap */
+    inline size_t gallop(const std::vector<uint64_t> &keys, size_t lo, uint64_t target)
+    {
+        size_t step = 1;
+        size_t hi = lo;
+
+        while (hi < keys.size() && keys[hi] < target)
+        {
+            lo = hi + 1;
+            hi += step;
+            step *= 2;
+        }
+
+        hi = std::min(hi, keys.size());
+
+        return std::lower_bound(keys.begin() + lo, keys.begin() + hi, target) - keys.begin();
+    }
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t ndocs;
+        uint64_t nterms;
+        uint64_t docs_offset;
+        uint64_t terms_offset;
+        uint64_t strings_offset;
+        uint64_t postings_offset;
+        uint64_t file_size;
+    };
+
+    struct DocEntry
+    {
+        uint64_t name_offset;
+        uint64_t name_length;
+    };
+
+    struct TermEntry
+    {
+        uint64_t name_offset;
+        uint32_t name_length;
+        uint32_t count;
+        uint64_t postings_offset;
+        uint64_t postings_length;
+    };
+}
+
+/** This builds an inverted index of a set of text files, mapping every
+    word to the places (document, line and word position) it occurs. */
+class IndexBuilder
+{
+public:
+    /** Index all of the passed files. The files are tokenised in parallel,
+        then the postings of every word are gathered and compressed in
+        parallel */
+    explicit IndexBuilder(const std::vector<std::string> &filenames)
+        : docs(filenames)
+    {
+        typedef std::unordered_map<std::string, std::vector<detail::Occurrence>> DocPostings;
+
+        std::vector<DocPostings> doc_postings(docs.size());
+
+        tbb::parallel_for( size_t(0), docs.size(), [&](size_t d)
+        {
+            wordcount::detail::FileText text( docs[d] );
+
+            uint64_t pos = 0;
+
+            wordcount::detail::for_each_word_and_line(text.data, text.size,
+                                        [&](const std::string &word, size_t line)
+            {
+                doc_postings[d][word].push_back( detail::Occurrence{ pos, uint32_t(line) } );
+                pos += 1;
+            });
+        });
+
+        for (const DocPostings &postings : doc_postings)
+        {
+            for (const auto &item : postings)
+            {
+                terms.push_back(item.first);
+            }
+        }
+
+        tbb::parallel_sort(terms.begin(), terms.end());
+        terms.erase( std::unique(terms.begin(), terms.end()), terms.end() );
+
+        counts.resize(terms.size());
+        postings.resize(terms.size());
+
+        tbb::parallel_for( size_t(0), terms.size(), [&](size_t t)
+        {
+            std::string &out = postings[t];
+            uint64_t last_doc = 0;
+            uint32_t count = 0;
+
+            for (size_t d=0; d<docs.size(); ++d)
+            {
+                auto it = doc_postings[d].find(terms[t]);
+
+                if (it == doc_postings[d].end())
+                {
+                    continue;
+                }
+
+                uint64_t last_pos = 0;
+                uint64_t last_line = 0;
+                bool first = true;
+
+                for (const detail::Occurrence &occ : it->second)
+                {
+                    // the first posting uses a doc gap of d+1, so that a gap
+                    // of 0 always means "same document as before"
+                    detail::put_varint(out, first ? (d + 1 - last_doc) : 0);
+                    detail::put_varint(out, occ.pos - last_pos);
+                    detail::put_varint(out, occ.line - last_line);
+
+                    last_pos = occ.pos;
+                    last_line = occ.line;
+                    first = false;
+                    count += 1;
+                }
+
+                last_doc = d + 1;
+            }
+
+            counts[t] = count;
+        });
+    }
+
+    /** Write the index to 'filename' in the format read by MappedIndex */
+    bool save(const std::string &filename) const
+    {
+        std::string strings;
+        std::vector<detail::DocEntry> doc_entries(docs.size());
+        std::vector<detail::TermEntry> term_entries(terms.size());
+
+        for (size_t d=0; d<docs.size(); ++d)
+        {
+            doc_entries[d] = detail::DocEntry{ strings.size(), docs[d].size() };
+            strings += docs[d];
+        }
+
+        uint64_t postings_size = 0;
+
+        for (size_t t=0; t<terms.size(); ++t)
+        {
+            term_entries[t] = detail::TermEntry{ strings.size(), uint32_t(terms[t].size()),
+                                                 counts[t], postings_size, postings[t].size() };
+            strings += terms[t];
+            postings_size += postings[t].size();
+        }
+
+        detail::FileHeader header;
+        std::memcpy(header.magic, "INVX", 4);
+        header.version = 1;
+        header.ndocs = docs.size();
+        header.nterms = terms.size();
+        header.docs_offset = sizeof(detail::FileHeader);
+        header.terms_offset = header.docs_offset + doc_entries.size() * sizeof(detail::DocEntry);
+        header.strings_offset = header.terms_offset + term_entries.size() * sizeof(detail::TermEntry);
+        header.postings_offset = header.strings_offset + strings.size();
+        header.file_size = header.postings_offset + postings_size;
+
+        std::ofstream out( filename, std::ios::binary );
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(doc_entries.data()),
+                  doc_entries.size() * sizeof(detail::DocEntry));
+        out.write(reinterpret_cast<const char*>(term_entries.data()),
+                  term_entries.size() * sizeof(detail::TermEntry));
+        out.write(strings.data(), strings.size());
+
+        for (const std::string &p : postings)
+        {
+            out.write(p.data(), p.size());
+        }
+
+        return bool(out);
+    }
+
+    std::vector<std::string> docs;
+    std::vector<std::string> terms;
+    std::vector<uint32_t> counts;
+    std::vector<std::string> postings;
+};
+
+/** This is a read-only, memory-mapped inverted index written by
+    IndexBuilder::save. Opening it only maps the file, so an index is
+    ready to query as soon as it is opened */
+class MappedIndex
+{
+public:
+    explicit MappedIndex(const std::string &filename)
+        : file(filename), header(nullptr)
+    {
+        if (file.data && file.size >= sizeof(detail::FileHeader))
+        {
+            const auto *h = reinterpret_cast<const detail::FileHeader*>(file.data);
+
+            if (std::memcmp(h->magic, "INVX", 4) == 0 && h->version == 1 &&
+                h->file_size == file.size)
+            {
+                header = h;
+            }
+        }
+    }
+
+    bool valid() const
+    {
+        return header != nullptr;
+    }
+
+    size_t ndocs() const
+    {
+        return header ? header->ndocs : 0;
+    }
+
+    size_t nterms() const
+    {
+        return header ? header->nterms : 0;
+    }
+
+    std::string doc_name(size_t d) const
+    {
+        const auto &entry = docs()[d];
+        return std::string(strings() + entry.name_offset, entry.name_length);
+    }
+
+    /** Return the number of times 'word' occurs in all documents */
+    size_t count(const std::string &word) const
+    {
+        const detail::TermEntry *entry = find(word);
+        return entry ? entry->count : 0;
+    }
+
+    /** Return every place where the words of 'phrase' occur next to each
+        other, in order. The rarest word's postings are used as the starting
+        candidates, and the candidates are intersected with the postings of
+        each other word using galloping search */
+    std::vector<Hit> search(const std::string &phrase) const
+    {
+        std::vector<std::string> words;
+
+        wordcount::detail::for_each_word(phrase.data(), phrase.size(), [&](const std::string &word)
+        {
+            words.push_back(word);
+        });
+
+        std::vector<Hit> hits;
+
+        if (words.empty() || !header)
+        {
+            return hits;
+        }
+
+        std::vector<const detail::TermEntry*> entries(words.size());
+
+        for (size_t i=0; i<words.size(); ++i)
+        {
+            entries[i] = find(words[i]);
+
+            if (!entries[i])
+            {
+                return hits;
+            }
+        }
+
+        size_t rarest = 0;
+
+        for (size_t i=1; i<words.size(); ++i)
+        {
+            if (entries[i]->count < entries[rarest]->count)
+            {
+                rarest = i;
+            }
+        }
+
+        // candidates are the keys of the phrase's first word
+        std::vector<uint64_t> candidates;
+        decode(entries[rarest], candidates, nullptr);
+
+        size_t nkept = 0;
+
+        for (uint64_t key : candidates)
+        {
+            if ((key & ((uint64_t(1) << detail::doc_shift) - 1)) >= rarest)
+            {
+                candidates[nkept++] = key - rarest;
+            }
+        }
+
+        candidates.resize(nkept);
+
+        std::vector<uint64_t> keys;
+
+        for (size_t i=0; i<words.size() && !candidates.empty(); ++i)
+        {
+            if (i == rarest)
+            {
+                continue;
+            }
+
+            decode(entries[i], keys, nullptr);
+
+            size_t cursor = 0;
+            nkept = 0;
+
+            for (uint64_t start : candidates)
+            {
+                cursor = detail::gallop(keys, cursor, start + i);
+
+                if (cursor == keys.size())
+                {
+                    break;
+                }
+
+                if (keys[cursor] == start + i)
+                {
+                    candidates[nkept++] = start;
+                }
+            }
+
+            candidates.resize(nkept);
+        }
+
+        // look up the line of the first word of each match
+        std::vector<uint32_t> lines;
+        decode(entries[0], keys, &lines);
+
+        size_t cursor = 0;
+
+        for (uint64_t start : candidates)
+        {
+            cursor = detail::gallop(keys, cursor, start);
+
+            // documents are numbered from 1 in the keys
+            hits.push_back( Hit{ uint32_t((start >> detail::doc_shift) - 1), lines[cursor] } );
+        }
+
+        return hits;
+    }
+
+private:
+    const detail::DocEntry* docs() const
+    {
+        return reinterpret_cast<const detail::DocEntry*>(file.data + header->docs_offset);
+    }
+
+    const detail::TermEntry* terms() const
+    {
+        return reinterpret_cast<const detail::TermEntry*>(file.data + header->terms_offset);
+    }
+
+    const char* strings() const
+    {
+        return file.data + header->strings_offset;
+    }
+
+    /** Binary search the (sorted) term table for 'word' */
+    const detail::TermEntry* find(const std::string &word) const
+    {
+        if (!header)
+        {
+            return nullptr;
+        }
+
+        const detail::TermEntry *begin = terms();
+        const detail::TermEntry *end = begin + header->nterms;
+
+        const detail::TermEntry *it = std::lower_bound(begin, end, word,
+                                  [&](const detail::TermEntry &entry, const std::string &w)
+        {
+            return w.compare(0, w.size(), strings() + entry.name_offset, entry.name_length) > 0;
+        });
+
+        if (it != end && word.compare(0, word.size(), strings() + it->name_offset,
+                                      it->name_length) == 0)
+        {
+            return it;
+        }
+
+        return nullptr;
+    }
+
+    void decode(const detail::TermEntry *entry, std::vector<uint64_t> &keys,
+                std::vector<uint32_t> *lines) const
+    {
+        const uint8_t *p = reinterpret_cast<const uint8_t*>(file.data + header->postings_offset
+                                                            + entry->postings_offset);
+        detail::decode(p, entry->count, keys, lines);
+    }
+
+    filecounter::detail::MappedFile file;
+    const detail::FileHeader *header;
+};
+
+} // end of namespace invindex
+
+#endif // FILECOUNTER_HAVE_MMAP
+
+#endif
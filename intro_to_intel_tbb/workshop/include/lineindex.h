@@ -0,0 +1,481 @@
+#ifndef lineindex_h
+#define lineindex_h
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include "filecounter.h"
+
+#ifdef FILECOUNTER_HAVE_MMAP
+
+namespace filecounter
+{
+
+/** Return the directory that line indexes are saved in. If this is empty
+    (the default) each index is saved next to its file. Set it before any
+    index is used, e.g. index_directory() = "/tmp/lidx"; */
+inline std::string& index_directory()
+{
+    static std::string directory;
+    return directory;
+}
+
+/** This identifies the version of a file that an index was built from.
+    If any of these change, the file has changed and the index is stale */
+struct FileStamp
+{
+    uint64_t size = 0;
+    uint64_t mtime_sec = 0;
+    uint64_t mtime_nsec = 0;
+    uint64_t inode = 0;
+
+    bool operator==(const FileStamp &other) const
+    {
+        return size == other.size && mtime_sec == other.mtime_sec &&
+               mtime_nsec == other.mtime_nsec && inode == other.inode;
+    }
+
+    bool operator!=(const FileStamp &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+/** This is an index of the start offset of every line in a file. It is
+    saved next to the file as '<filename>.lidx' (or in index_directory(),
+    if that is set), so that the next time the file is counted, or a line
+    is looked up, the file need not be rescanned.
+
+    The sidecar file holds a fixed-size header (magic, version, file stamp,
+    number of lines and the width of each offset) followed by the offsets.
+    Offsets are stored as 32-bit integers for files under 4 GiB and as
+    64-bit integers otherwise */
+class LineIndex
+{
+public:
+    LineIndex() : nlines(0)
+    {}
+
+    /** Build the index for 'filename' by scanning it */
+    static LineIndex build(const std::string &filename)
+    {
+        LineIndex index;
+
+        if (!get_stamp(filename, index.stamp))
+        {
+            return index;
+        }
+
+        detail::MappedFile file( filename );
+
+        if (!file.data)
+        {
+            return index;
+        }
+
+        const CountOptions &options = count_options();
+
+        if (file.size < options.parallel_threshold)
+        {
+            index.offsets.push_back(0);
+
+            detail::for_each_newline(file.data, file.size, [&](size_t pos)
+            {
+                index.offsets.push_back(pos + 1);
+            });
+        }
+        else
+        {
+            // count the newlines in each chunk in parallel, then use the
+            // running total to let every chunk write its own offsets
+            const size_t chunk_size = std::max<size_t>(options.chunk_size, 4096);
+            const size_t nchunks = (file.size + chunk_size - 1) / chunk_size;
+
+            std::vector<size_t> starts(nchunks + 1, 0);
+
+            tbb::parallel_for( size_t(0), nchunks, [&](size_t c)
+            {
+                const size_t begin = c * chunk_size;
+                const size_t end = std::min(file.size, begin + chunk_size);
+                starts[c+1] = detail::count_newlines(file.data + begin, end - begin);
+            });
+
+            for (size_t c=0; c<nchunks; ++c)
+            {
+                starts[c+1] += starts[c];
+            }
+
+            index.offsets.resize(starts[nchunks] + 1);
+            index.offsets[0] = 0;
+
+            tbb::parallel_for( size_t(0), nchunks, [&](size_t c)
+            {
+                const size_t begin = c * chunk_size;
+                const size_t end = std::min(file.size, begin + chunk_size);
+                size_t j = starts[c] + 1;
+
+                detail::for_each_newline(file.data + begin, end - begin, [&](size_t pos)
+                {
+                    index.offsets[j++] = begin + pos + 1;
+                });
+            });
+        }
+
+        // a newline at the very end does not start another line
+        if (index.offsets.back() == file.size)
+        {
+            index.offsets.pop_back();
+        }
+
+        index.nlines = index.offsets.size();
+
+        return index;
+    }
+
+    /** Write the index to 'index_filename'. Returns false if it could
+        not be written (e.g. the directory is read-only), or if there is
+        nothing to save because the file did not exist */
+    bool save(const std::string &index_filename) const
+    {
+        if (stamp == FileStamp())
+        {
+            return false;
+        }
+
+        if (!index_directory().empty())
+        {
+            // fails harmlessly if the directory already exists
+            ::mkdir(index_directory().c_str(), 0777);
+        }
+
+        std::ofstream out( index_filename + ".tmp", std::ios::binary );
+
+        if (!out)
+        {
+            return false;
+        }
+
+        const uint32_t width = offset_width(stamp.size);
+
+        write_header(out, width);
+
+        if (width == 4)
+        {
+            std::vector<uint32_t> narrow(offsets.begin(), offsets.end());
+            out.write(reinterpret_cast<const char*>(narrow.data()), narrow.size() * 4);
+        }
+        else
+        {
+            out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * 8);
+        }
+
+        out.close();
+
+        if (!out)
+        {
+            std::remove( (index_filename + ".tmp").c_str() );
+            return false;
+        }
+
+        // rename is atomic, so readers never see a half-written index
+        return std::rename( (index_filename + ".tmp").c_str(), index_filename.c_str() ) == 0;
+    }
+
+    /** Set 's' to the stamp of the current version of 'filename'.
+        Returns false (leaving 's' all zero) if the file does not exist */
+    static bool get_stamp(const std::string &filename, FileStamp &s)
+    {
+        struct stat st;
+
+        s = FileStamp();
+
+        if (::stat(filename.c_str(), &st) != 0)
+        {
+            return false;
+        }
+
+        s.size = st.st_size;
+        s.inode = st.st_ino;
+#ifdef __APPLE__
+        s.mtime_sec = st.st_mtimespec.tv_sec;
+        s.mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+        s.mtime_sec = st.st_mtim.tv_sec;
+        s.mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+        return true;
+    }
+
+    /** Return the stamp of the current version of 'filename', which is
+        all zero if the file does not exist */
+    static FileStamp stamp_of(const std::string &filename)
+    {
+        FileStamp s;
+        get_stamp(filename, s);
+        return s;
+    }
+
+    /** Return the name of the index file of 'filename'. In index_directory()
+        this is the file's absolute path with '%' and '/' escaped, so that
+        files with the same name in different directories do not clash */
+    static std::string index_filename(const std::string &filename)
+    {
+        if (index_directory().empty())
+        {
+            return filename + ".lidx";
+        }
+
+        std::string path = filename;
+
+        if (char *absolute = ::realpath(filename.c_str(), nullptr))
+        {
+            path = absolute;
+            std::free(absolute);
+        }
+
+        std::string name;
+
+        for (char c : path)
+        {
+            if (c == '%')
+            {
+                name += "%25";
+            }
+            else if (c == '/')
+            {
+                name += "%2F";
+            }
+            else
+            {
+                name += c;
+            }
+        }
+
+        return index_directory() + "/" + name + ".lidx";
+    }
+
+    /** This is the header at the start of every index file */
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        FileStamp stamp;
+        uint64_t nlines;
+        uint32_t width;
+        uint32_t padding;
+    };
+
+    /** Read the header of an index file from 'in' and check that it
+        matches 'stamp', and that the file holds exactly 'nlines' offsets.
+        Returns false if the index is invalid, truncated or stale. On
+        success 'in' is left at the start of the offsets */
+    static bool read_header(std::ifstream &in, const FileStamp &stamp, Header &header)
+    {
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(Header)))
+        {
+            return false;
+        }
+
+        if (std::memcmp(header.magic, "LIDX", 4) != 0 || header.version != 1 ||
+            header.stamp != stamp || (header.width != 4 && header.width != 8))
+        {
+            return false;
+        }
+
+        in.seekg(0, std::ios::end);
+        const std::streamoff length = in.tellg();
+        in.seekg(sizeof(Header));
+
+        if (!in || length < std::streamoff(sizeof(Header)))
+        {
+            return false;
+        }
+
+        // divide rather than multiply, so a corrupt 'nlines' cannot overflow
+        const uint64_t nbytes = uint64_t(length) - sizeof(Header);
+
+        return nbytes % header.width == 0 && nbytes / header.width == header.nlines;
+    }
+
+    std::vector<uint64_t> offsets;
+    uint64_t nlines;
+    FileStamp stamp;
+
+private:
+    static uint32_t offset_width(uint64_t size)
+    {
+        return (size <= 0xFFFFFFFFull) ? 4 : 8;
+    }
+
+    void write_header(std::ofstream &out, uint32_t width) const
+    {
+        Header header;
+        std::memcpy(header.magic, "LIDX", 4);
+        header.version = 1;
+        header.stamp = stamp;
+        header.nlines = nlines;
+        header.width = width;
+        header.padding = 0;
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    }
+};
+
+namespace detail
+{
+    /** Make sure that an up-to-date index exists for 'filename', building
+        and saving one if needed. Returns true (with the new index in 'built')
+        if the index had to be built, which includes when the file does not
+        exist (nothing is saved then, and 'built' is empty) */
+    inline bool ensure_index(const std::string &filename, LineIndex &built)
+    {
+        FileStamp stamp;
+
+        if (!LineIndex::get_stamp(filename, stamp))
+        {
+            built = LineIndex();
+            return true;
+        }
+
+        std::ifstream in( LineIndex::index_filename(filename), std::ios::binary );
+        LineIndex::Header header;
+
+        if (in && LineIndex::read_header(in, stamp, header))
+        {
+            return false;
+        }
+
+        built = LineIndex::build(filename);
+        built.save( LineIndex::index_filename(filename) );
+
+        return true;
+    }
+}
+
+/** Return the number of lines in 'filename'. If the file has an up-to-date
+    index this only reads the index header, otherwise the index is built
+    (using the fast counting path) and saved for next time. A file that
+    does not exist has 0 lines, and no index is saved for it */
+inline size_t cached_count_lines(const std::string &filename)
+{
+    FileStamp stamp;
+
+    if (!LineIndex::get_stamp(filename, stamp))
+    {
+        return 0;
+    }
+
+    std::ifstream in( LineIndex::index_filename(filename), std::ios::binary );
+    LineIndex::Header header;
+
+    if (in && LineIndex::read_header(in, stamp, header))
+    {
+        return header.nlines;
+    }
+
+    LineIndex index = LineIndex::build(filename);
+    index.save( LineIndex::index_filename(filename) );
+
+    return index.nlines;
+}
+
+/** Return line 'n' (counting from 0) of 'filename', without its newline.
+    The index is used to seek straight to the line. If the saved offsets
+    cannot be read, or do not lie within the file, the index is rebuilt.
+    Returns an empty string if there is no such line */
+inline std::string get_line(const std::string &filename, size_t n)
+{
+    uint64_t begin = 0;
+    uint64_t end = 0;
+
+    LineIndex built;
+    bool use_built = detail::ensure_index(filename, built);
+
+    if (!use_built)
+    {
+        std::ifstream in( LineIndex::index_filename(filename), std::ios::binary );
+        LineIndex::Header header;
+
+        if (!LineIndex::read_header(in, LineIndex::stamp_of(filename), header))
+        {
+            // the file changed (or the index was damaged) since ensure_index
+            use_built = true;
+        }
+        else if (n >= header.nlines)
+        {
+            return std::string();
+        }
+        else
+        {
+            // read the offsets of this line and the next one
+            in.seekg(sizeof(LineIndex::Header) + n * header.width);
+
+            uint64_t pair[2] = { 0, 0 };
+            const size_t nread = (n + 1 < header.nlines) ? 2 : 1;
+
+            if (header.width == 4)
+            {
+                uint32_t narrow[2] = { 0, 0 };
+                in.read(reinterpret_cast<char*>(narrow), nread * 4);
+                pair[0] = narrow[0];
+                pair[1] = narrow[1];
+            }
+            else
+            {
+                in.read(reinterpret_cast<char*>(pair), nread * 8);
+            }
+
+            begin = pair[0];
+            end = (nread == 2) ? pair[1] : header.stamp.size;
+
+            // don't trust offsets that could not be read or are out of order
+            use_built = !in || begin > end || end > header.stamp.size;
+        }
+
+        if (use_built)
+        {
+            built = LineIndex::build(filename);
+            built.save( LineIndex::index_filename(filename) );
+        }
+    }
+
+    if (use_built)
+    {
+        if (n >= built.nlines)
+        {
+            return std::string();
+        }
+
+        begin = built.offsets[n];
+        end = (n + 1 < built.nlines) ? built.offsets[n+1] : built.stamp.size;
+    }
+
+    std::ifstream file( filename, std::ios::binary );
+    file.seekg(begin);
+
+    std::string line(end - begin, '\0');
+    file.read(&line[0], line.size());
+    line.resize(file.gcount());
+
+    if (!line.empty() && line.back() == '\n')
+    {
+        line.pop_back();
+    }
+
+    return line;
+}
+
+} // end of namespace filecounter
+
+#endif // FILECOUNTER_HAVE_MMAP
+
+#endif
@@ -8,46 +8,60 @@
 #include <string>
 #include <fstream>
 #include <random>
+#include <type_traits>
 
 #include <tbb/parallel_for.h>
 #include <tbb/parallel_reduce.h>
 #include <tbb/tick_count.h>
 
+#include "philox.h"
+#include "telemetry.h"
+#include "arena.h"
+#include "range.h"
+#include "runtime.h"
+
 namespace part1
 {
 
 namespace detail
 {
     template<class ARG>
-    size_t get_min_container_size(const std::vector<ARG> &arg)
-    {
-        return arg.size();
-    }
-
-    template<class ARG1, class ARG2>
-    size_t get_min_container_size(const std::vector<ARG1> &arg1, const std::vector<ARG2> &arg2)
+    size_t get_min_container_size(const ARG &arg)
     {
-        return std::min(arg1.size(), arg2.size());
+        return range_size(arg);
     }
 
     template<class ARG1, class ARG2, class... ARGS>
-    size_t get_min_container_size(const std::vector<ARG1> &arg1, const std::vector<ARG2> &arg2,
-                                  const std::vector<ARGS>&... args)
+    size_t get_min_container_size(const ARG1 &arg1, const ARG2 &arg2, const ARGS&... args)
     {
-        size_t minsize = get_min_container_size(args...);
-        return std::min( minsize, get_min_container_size(arg1,arg2) );
+        size_t minsize = get_min_container_size(arg2, args...);
+        return std::min( minsize, range_size(arg1) );
     }
 
     std::default_random_engine generator;
     std::uniform_real_distribution<double> distribution(0.0,1.0);
+
+    /** Return the 'i'th point of the random sequence for 'seed'. Each
+        point depends only on (seed, i), so points can be generated in
+        any order, on any thread */
+    template<class POINT>
+    POINT random_point(uint64_t seed, uint64_t i, float sz)
+    {
+        const auto r = Philox4x32::generate(seed, 0, i);
+
+        return POINT( sz * to_unit_float(r[0]),
+                      sz * to_unit_float(r[1]),
+                      sz * to_unit_float(r[2]) );
+    }
 }
 
 /** This will map the function 'func' against the array(s) of argument(s) in args,
     returning a vector of results */
-template<class FUNC, class... ARGS>
-auto map(FUNC func, const std::vector<ARGS>&... args)
+template<class FUNC, class... ARGS,
+         class = detail::enable_if_ranges<ARGS...>>
+auto map(FUNC func, const ARGS&... args)
 {
-    typedef typename std::result_of<FUNC(ARGS...)>::type RETURN_TYPE;
+    typedef typename std::result_of<FUNC(detail::range_value_t<ARGS>...)>::type RETURN_TYPE;
 
     int nvals=detail::get_min_container_size(args...);
 
@@ -61,11 +75,66 @@ auto map(FUNC func, const std::vector<ARGS>&... args)
     return result;
 }
 
+/** This will map the function 'func' against the array(s) of argument(s) in args,
+    writing the results to the output iterator 'out', which must have room for
+    as many values as the shortest argument array. This returns the iterator
+    one past the last value written */
+template<class FUNC, class OUTPUT, class... ARGS,
+         class = detail::enable_if_ranges<ARGS...>>
+OUTPUT map_into(FUNC func, OUTPUT out, const ARGS&... args)
+{
+    size_t nvals=detail::get_min_container_size(args...);
+
+    for (size_t i=0; i<nvals; ++i, ++out)
+    {
+        *out = func(args[i]...);
+    }
+
+    return out;
+}
+
+/** This will replace every value in 'values' with 'func' applied to that value */
+template<class FUNC, class RANGE,
+         class = detail::enable_if_ranges<typename std::remove_reference<RANGE>::type>>
+void map_inplace(FUNC func, RANGE &&values)
+{
+    auto *data = detail::range_data(values);
+    const size_t nvals = detail::range_size(values);
+
+    for (size_t i=0; i<nvals; ++i)
+    {
+        data[i] = func(data[i]);
+    }
+}
+
+/** This is the same as map, except that the returned vector uses
+    (a rebound copy of) the allocator 'alloc', e.g. an ArenaAllocator */
+template<class ALLOC, class FUNC, class... ARGS,
+         class = detail::enable_if_ranges<ARGS...>>
+auto map_alloc(const ALLOC &alloc, FUNC func, const ARGS&... args)
+{
+    typedef typename std::result_of<FUNC(detail::range_value_t<ARGS>...)>::type RETURN_TYPE;
+    typedef typename std::allocator_traits<ALLOC>::template rebind_alloc<RETURN_TYPE> RETURN_ALLOC;
+
+    size_t nvals=detail::get_min_container_size(args...);
+
+    std::vector<RETURN_TYPE,RETURN_ALLOC> result(nvals, RETURN_TYPE(), RETURN_ALLOC(alloc));
+
+    map_into(func, result.begin(), args...);
+
+    return result;
+}
+
 /** This will reduce the passed array of values using the function 'func' */
-template<class FUNC, class T>
-T reduce(FUNC func, const std::vector<T> &values)
+template<class FUNC, class RANGE,
+         class = detail::enable_if_ranges<RANGE>>
+auto reduce(FUNC func, const RANGE &values)
 {
-    if (values.empty())
+    typedef detail::range_value_t<RANGE> T;
+
+    const size_t nvals = detail::range_size(values);
+
+    if (nvals == 0)
     {
         return T();
     }
@@ -73,7 +142,7 @@ T reduce(FUNC func, const std::vector<T> &values)
     {
         T result = values[0];
 
-        for (size_t i=1; i<values.size(); ++i)
+        for (size_t i=1; i<nvals; ++i)
         {
             result = func(result, values[i]);
         }
@@ -84,10 +153,13 @@ T reduce(FUNC func, const std::vector<T> &values)
 
 /** This will reduce the passed array of values using the function 'func',
     starting from the initial value 'initial' */
-template<class FUNC, class T>
-T reduce(FUNC func, const std::vector<T> &values, const T &initial)
+template<class FUNC, class RANGE, class T,
+         class = detail::enable_if_ranges<RANGE>>
+T reduce(FUNC func, const RANGE &values, const T &initial)
 {
-    if (values.empty())
+    const size_t nvals = detail::range_size(values);
+
+    if (nvals == 0)
     {
      	return initial;
     }
@@ -95,22 +167,23 @@ T reduce(FUNC func, const std::vector<T> &values, const T &initial)
     {
      	T result = initial;
 
-        for (const T &value : values)
+        for (size_t i=0; i<nvals; ++i)
         {
-            result = func(result, value);
+            result = func(result, values[i]);
         }
 
 	return result;
     }
 }
 
-/** This will map the passed function onto the passed vector(s)
+/** This will map the passed function onto the passed array(s)
     of argument(s), and will use the passed reduction function to
     reduce the result */
-template<class MAPFUNC, class REDFUNC, class... ARGS>
-auto mapReduce(MAPFUNC mapfunc, REDFUNC redfunc, const std::vector<ARGS>&... args)
+template<class MAPFUNC, class REDFUNC, class... ARGS,
+         class = detail::enable_if_ranges<ARGS...>>
+auto mapReduce(MAPFUNC mapfunc, REDFUNC redfunc, const ARGS&... args)
 {
-    typedef typename std::result_of<MAPFUNC(ARGS...)>::type RETURN_TYPE;
+    typedef typename std::result_of<MAPFUNC(detail::range_value_t<ARGS>...)>::type RETURN_TYPE;
      
     int nvals=detail::get_min_container_size(args...);
 
@@ -134,38 +207,196 @@ auto mapReduce(MAPFUNC mapfunc, REDFUNC redfunc, const std::vector<ARGS>&... arg
     return result;
 }
 
-namespace parallel
+namespace detail
 {
+    /** This is the body used by tbb::parallel_reduce. 'chunkfunc' reduces
+        a range of elements onto a running result. TBB only splits the body
+        when a subrange is stolen by another worker, so this is where steals
+        are counted */
+    template<class T, class CHUNKFUNC, class REDFUNC, class RECORDER>
+    class ReduceBody
+    {
+    public:
+        ReduceBody(const CHUNKFUNC &_chunkfunc, const REDFUNC &_redfunc,
+                   RECORDER &_recorder, const T &_identity)
+            : chunkfunc(_chunkfunc), redfunc(_redfunc), recorder(_recorder),
+              identity(_identity), result(_identity)
+        {}
+
+        ReduceBody(ReduceBody &other, tbb::split)
+            : chunkfunc(other.chunkfunc), redfunc(other.redfunc),
+              recorder(other.recorder), identity(other.identity),
+              result(other.identity)
+        {
+            recorder.record_steal();
+        }
+
+        void operator()(const tbb::blocked_range<int> &r)
+        {
+            tbb::tick_count start;
+
+            if (RECORDER::enabled)
+            {
+                start = tbb::tick_count::now();
+            }
+
+            result = chunkfunc(r, result);
+
+            if (RECORDER::enabled)
+            {
+                recorder.record_chunk(r.begin(), r.end(), start, tbb::tick_count::now());
+            }
+        }
+
+        void join(ReduceBody &rhs)
+        {
+            result = redfunc(result, rhs.result);
+        }
+
+        const CHUNKFUNC &chunkfunc;
+        const REDFUNC &redfunc;
+        RECORDER &recorder;
+        const T &identity;
+        T result;
+    };
+
+    template<class RECORDER, class MAPFUNC, class REDFUNC, class... ARGS>
+    auto parallel_mapReduce(RECORDER &recorder, MAPFUNC mapfunc, REDFUNC redfunc,
+                            const ARGS&... args)
+    {
+        typedef typename std::result_of<MAPFUNC(detail::range_value_t<ARGS>...)>::type RETURN_TYPE;
+
+        int nvals=get_min_container_size(args...);
+
+        auto chunkfunc = [&](const tbb::blocked_range<int> &r, RETURN_TYPE task_result)
+        {
+            for (int i=r.begin(); i<r.end(); ++i)
+            {
+                task_result = redfunc(task_result, mapfunc(args[i]...) );
+            }
+
+            return task_result;
+        };
+
+        const RETURN_TYPE identity(0);
 
-template<class MAPFUNC, class REDFUNC, class... ARGS>
-auto mapReduce(MAPFUNC mapfunc, REDFUNC redfunc, const std::vector<ARGS>&... args)
+        ReduceBody<RETURN_TYPE, decltype(chunkfunc), REDFUNC, RECORDER>
+                                body(chunkfunc, redfunc, recorder, identity);
+
+        runtime::execute( [&]()
+        {
+            tbb::parallel_reduce( tbb::blocked_range<int>(0,nvals), body );
+        });
+
+        return body.result;
+    }
+}
+
+namespace parallel
 {
-    typedef typename std::result_of<MAPFUNC(ARGS...)>::type RETURN_TYPE;
 
+/** This will map the function 'func' against the array(s) of argument(s) in args,
+    writing the results to the random-access iterator 'out', in parallel.
+    This returns the iterator one past the last value written */
+template<class FUNC, class OUTPUT, class... ARGS,
+         class = detail::enable_if_ranges<ARGS...>>
+OUTPUT map_into(FUNC func, OUTPUT out, const ARGS&... args)
+{
     int nvals=detail::get_min_container_size(args...);
 
-    RETURN_TYPE result =
-         tbb::parallel_reduce( tbb::blocked_range<int>(0,nvals),
-                               RETURN_TYPE(0),
-               [&](tbb::blocked_range<int> r, RETURN_TYPE task_result)
-         {
-             for (int i=r.begin(); i<r.end(); ++i)
-             {
-                 task_result = redfunc(task_result, mapfunc(args[i]...) );
-             }
+    runtime::execute( [&]()
+    {
+        tbb::parallel_for( tbb::blocked_range<int>(0,nvals),
+                           [&](tbb::blocked_range<int> r)
+        {
+            for (int i=r.begin(); i<r.end(); ++i)
+            {
+                out[i] = func(args[i]...);
+            }
+        });
+    });
+
+    return out + nvals;
+}
+
+/** This will replace every value in 'values' with 'func' applied to
+    that value, in parallel */
+template<class FUNC, class RANGE,
+         class = detail::enable_if_ranges<typename std::remove_reference<RANGE>::type>>
+void map_inplace(FUNC func, RANGE &&values)
+{
+    auto *data = detail::range_data(values);
+    const size_t nvals = detail::range_size(values);
+
+    runtime::execute( [&]()
+    {
+        tbb::parallel_for( tbb::blocked_range<size_t>(0,nvals),
+                           [&](tbb::blocked_range<size_t> r)
+        {
+            for (size_t i=r.begin(); i<r.end(); ++i)
+            {
+                data[i] = func(data[i]);
+            }
+        });
+    });
+}
+
+/** This will map the function 'func' against the array(s) of argument(s)
+    in args in parallel, returning a vector of results */
+template<class FUNC, class... ARGS,
+         class = detail::enable_if_ranges<ARGS...>>
+auto map(FUNC func, const ARGS&... args)
+{
+    typedef typename std::result_of<FUNC(detail::range_value_t<ARGS>...)>::type RETURN_TYPE;
 
-             return task_result;
+    std::vector<RETURN_TYPE> result(detail::get_min_container_size(args...));
 
-         }, redfunc );
+    parallel::map_into(func, result.begin(), args...);
 
-    return result;                               
+    return result;
+}
+
+/** This is the same as parallel::map, except that the returned vector
+    uses (a rebound copy of) the allocator 'alloc' */
+template<class ALLOC, class FUNC, class... ARGS,
+         class = detail::enable_if_ranges<ARGS...>>
+auto map_alloc(const ALLOC &alloc, FUNC func, const ARGS&... args)
+{
+    typedef typename std::result_of<FUNC(detail::range_value_t<ARGS>...)>::type RETURN_TYPE;
+    typedef typename std::allocator_traits<ALLOC>::template rebind_alloc<RETURN_TYPE> RETURN_ALLOC;
+
+    size_t nvals=detail::get_min_container_size(args...);
+
+    std::vector<RETURN_TYPE,RETURN_ALLOC> result(nvals, RETURN_TYPE(), RETURN_ALLOC(alloc));
+
+    parallel::map_into(func, result.begin(), args...);
+
+    return result;
+}
+
+template<class MAPFUNC, class REDFUNC, class... ARGS,
+         class = detail::enable_if_ranges<ARGS...>>
+auto mapReduce(MAPFUNC mapfunc, REDFUNC redfunc, const ARGS&... args)
+{
+    telemetry::NullRecorder recorder;
+    return detail::parallel_mapReduce(recorder, mapfunc, redfunc, args...);
+}
+
+/** This is the same as mapReduce, except that the wall time, worker id
+    and number of elements of every chunk are recorded into 'recorder' */
+template<class MAPFUNC, class REDFUNC, class... ARGS,
+         class = detail::enable_if_ranges<ARGS...>>
+auto mapReduce(telemetry::Recorder &recorder, MAPFUNC mapfunc, REDFUNC redfunc,
+               const ARGS&... args)
+{
+    return detail::parallel_mapReduce(recorder, mapfunc, redfunc, args...);
 }
 
 } // end of namespace parallel
 
 /** This prints the elements of a vector to the screen */
-template<class T>
-void print_vector(const std::vector<T> &values)
+template<class T, class ALLOC>
+void print_vector(const std::vector<T,ALLOC> &values)
 {
     std::cout << "[";
 
@@ -217,6 +448,50 @@ auto create_random_points(int n, float sz=50.0)
     return points;
 }
 
+/** Return a vector of 'n' randomly positioned points, located in
+    a cubic box of size 'sz', using the counter-based random stream
+    for 'seed'. The result is identical to parallel::create_random_points
+    called with the same arguments */
+inline auto create_random_points(int n, float sz, uint64_t seed)
+{
+    auto points = std::vector<Point>(n);
+
+    for (int i=0; i<n; ++i)
+    {
+        points[i] = detail::random_point<Point>(seed, i, sz);
+    }
+
+    return points;
+}
+
+namespace parallel
+{
+
+/** Return a vector of 'n' randomly positioned points, located in
+    a cubic box of size 'sz', generated in parallel. Point 'i' is
+    always made from block 'i' of the random stream for 'seed', so
+    the result is the same whatever the number of threads */
+inline auto create_random_points(int n, float sz=50.0, uint64_t seed=0)
+{
+    auto points = std::vector<Point>(n);
+
+    runtime::execute( [&]()
+    {
+        tbb::parallel_for( tbb::blocked_range<int>(0,n),
+                           [&](tbb::blocked_range<int> r)
+        {
+            for (int i=r.begin(); i<r.end(); ++i)
+            {
+                points[i] = detail::random_point<Point>(seed, i, sz);
+            }
+        });
+    });
+
+    return points;
+}
+
+} // end of namespace parallel
+
 } // end of namespace part1
 
 #endif
@@ -0,0 +1,292 @@
+#ifndef perthread_h
+#define perthread_h
+
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <tbb/task_arena.h>
+#include <tbb/global_control.h>
+#include <tbb/enumerable_thread_specific.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace part1
+{
+
+/** The size that per-thread data is padded to. Cache lines are 64 bytes,
+    but Intel CPUs fetch lines in adjacent pairs, so two threads writing
+    to neighbouring 64-byte lines can still slow each other down */
+const size_t cache_line_size = 128;
+
+/** These choose which slot of a PerThread the calling thread uses */
+struct OpenMPThreadIndex
+{
+    static int get()
+    {
+#ifdef _OPENMP
+        return omp_get_thread_num();
+#else
+        return 0;
+#endif
+    }
+
+    static int max_threads()
+    {
+#ifdef _OPENMP
+        return omp_get_max_threads();
+#else
+        return 1;
+#endif
+    }
+};
+
+namespace detail
+{
+    /** Hands out process-wide thread ids. A thread is given the smallest
+        id not in use the first time it asks, and hands it back when it
+        exits, so the ids stay close to the number of live threads */
+    class ThreadIdRegistry
+    {
+    public:
+        static ThreadIdRegistry& instance()
+        {
+            // never destroyed, as threads may exit after static destructors run
+            static ThreadIdRegistry *registry = new ThreadIdRegistry();
+            return *registry;
+        }
+
+        int acquire()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (free_ids.empty())
+            {
+                return next_id++;
+            }
+
+            std::pop_heap(free_ids.begin(), free_ids.end(), std::greater<int>());
+            const int id = free_ids.back();
+            free_ids.pop_back();
+
+            return id;
+        }
+
+        void release(int id)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            free_ids.push_back(id);
+            std::push_heap(free_ids.begin(), free_ids.end(), std::greater<int>());
+        }
+
+    private:
+        std::mutex mutex;
+        std::vector<int> free_ids;
+        int next_id = 0;
+    };
+
+    struct ThreadId
+    {
+        ThreadId() : id(ThreadIdRegistry::instance().acquire())
+        {}
+
+        ~ThreadId()
+        {
+            ThreadIdRegistry::instance().release(id);
+        }
+
+        int id;
+    };
+}
+
+/** A process-wide thread id, which is used for TBB threads. Unlike
+    tbb::this_task_arena::current_thread_index(), which numbers threads
+    separately within each arena (and is -1 outside of one), no two live
+    threads ever share an id */
+struct TBBThreadIndex
+{
+    static int get()
+    {
+        thread_local detail::ThreadId id;
+        return id.id;
+    }
+
+    static int max_threads()
+    {
+        return int(std::max<size_t>(tbb::this_task_arena::max_concurrency(),
+                   tbb::global_control::active_value(tbb::global_control::max_allowed_parallelism)));
+    }
+};
+
+/** Use the OpenMP thread number inside an OpenMP parallel region, and the
+    TBB thread index everywhere else. Nested OpenMP regions, or OpenMP
+    and TBB threads updating the same PerThread at once, are not supported */
+struct AnyThreadIndex
+{
+    static int get()
+    {
+#ifdef _OPENMP
+        if (omp_in_parallel())
+        {
+            return omp_get_thread_num();
+        }
+#endif
+        return TBBThreadIndex::get();
+    }
+
+    static int max_threads()
+    {
+        return std::max(OpenMPThreadIndex::max_threads(), TBBThreadIndex::max_threads());
+    }
+};
+
+/** This holds one value of type T for each thread, like
+    tbb::enumerable_thread_specific, but with each value in its own
+    cache_line_size-aligned slot. Threads updating their own values
+    therefore never share a cache line (no false sharing), and no locks
+    or atomics are needed. Slots are found by the thread's index (see
+    AnyThreadIndex), so local() is just an array lookup. A thread whose
+    index is past the last slot (e.g. a thread of a larger arena or team
+    than the PerThread was sized for) keeps its value in an overflow
+    tbb::enumerable_thread_specific instead, which is slower but correct.
+
+    Once the threads have finished, 'combine' folds all of the values
+    together, e.g. in place of the critical section in fixed_loopcount.cpp
+
+        PerThread<long> nloops;
+
+        #pragma omp parallel for
+        for (int i=0; i<100000; ++i)
+        {
+            ++nloops.local();
+        }
+
+        long total = nloops.combine(std::plus<long>());
+*/
+template<class T, class INDEX=AnyThreadIndex>
+class PerThread
+{
+public:
+    explicit PerThread(const T &initial=T())
+        : PerThread(INDEX::max_threads(), initial)
+    {}
+
+    PerThread(int nthreads, const T &initial)
+        : nslots(std::max(1, nthreads)), identity(initial), overflow(initial)
+    {
+        // over-allocate so that the first slot can start on a cache line,
+        // as new[] only guarantees alignof(std::max_align_t)
+        memory.reset( new char[nslots * slot_size + cache_line_size] );
+
+        const uintptr_t address = reinterpret_cast<uintptr_t>(memory.get());
+        const uintptr_t aligned = (address + cache_line_size - 1) & ~uintptr_t(cache_line_size - 1);
+
+        slots = reinterpret_cast<char*>(aligned);
+
+        for (int i=0; i<nslots; ++i)
+        {
+            new (slots + i * slot_size) T(initial);
+        }
+    }
+
+    ~PerThread()
+    {
+        for (int i=0; i<nslots; ++i)
+        {
+            slot(i).~T();
+        }
+    }
+
+    PerThread(const PerThread&) = delete;
+    PerThread& operator=(const PerThread&) = delete;
+
+    /** Return the calling thread's value */
+    T& local()
+    {
+        const int i = INDEX::get();
+
+        if (i < 0 || i >= nslots)
+        {
+            return overflow.local();
+        }
+
+        return slot(i);
+    }
+
+    /** Return the value of slot 'i' (not including the overflow values) */
+    T& operator[](int i)
+    {
+        return slot(i);
+    }
+
+    const T& operator[](int i) const
+    {
+        return const_cast<PerThread*>(this)->slot(i);
+    }
+
+    int size() const
+    {
+        return nslots;
+    }
+
+    /** Return all of the values folded together with 'func', in slot
+        order followed by any overflow values. This must only be called
+        when no thread is updating its value */
+    template<class FUNC>
+    T combine(FUNC func) const
+    {
+        T result = (*this)[0];
+
+        for (int i=1; i<nslots; ++i)
+        {
+            result = func(result, (*this)[i]);
+        }
+
+        for (const T &value : overflow)
+        {
+            result = func(result, value);
+        }
+
+        return result;
+    }
+
+    /** Set every value back to the initial value */
+    void clear()
+    {
+        for (int i=0; i<nslots; ++i)
+        {
+            slot(i) = identity;
+        }
+
+        overflow.clear();
+    }
+
+private:
+    static const size_t slot_size = ((sizeof(T) + cache_line_size - 1) / cache_line_size)
+                                    * cache_line_size;
+
+    T& slot(int i)
+    {
+        return *reinterpret_cast<T*>(slots + i * slot_size);
+    }
+
+    int nslots;
+    T identity;
+    std::unique_ptr<char[]> memory;
+    char *slots;
+
+    // the values of threads whose index is past the last slot
+    tbb::enumerable_thread_specific<T> overflow;
+};
+
+} // end of namespace part1
+
+#endif
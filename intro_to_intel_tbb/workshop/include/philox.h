@@ -0,0 +1,155 @@
+#ifndef philox_h
+#define philox_h
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace part1
+{
+
+/** This is a counter-based random number generator (Philox4x32-10,
+    Salmon et al. 2011). Instead of carrying state from one draw to
+    the next, every block of four 32-bit random numbers is a pure
+    function of (seed, stream, offset). This means that any thread can
+    jump straight to any position of any stream, and so the numbers
+    produced do not depend on how work is split between threads.
+
+    The 128-bit counter is made up of the 64-bit 'offset' (position
+    within a stream) and the 64-bit 'stream' id. The 64-bit 'seed' is
+    used as the key. */
+class Philox4x32
+{
+public:
+    typedef uint32_t result_type;
+    typedef std::array<uint32_t,4> block_type;
+
+    Philox4x32(uint64_t seed=0, uint64_t stream=0)
+        : seed_(seed), stream_(stream), offset_(0), index_(4)
+    {}
+
+    /** Return the block of four random numbers at position 'offset'
+        of this generator's stream. This does not change the state
+        of the generator */
+    block_type block(uint64_t offset) const
+    {
+        return generate(seed_, stream_, offset);
+    }
+
+    /** Return the block of four random numbers at position 'offset'
+        of stream 'stream', using key 'seed' */
+    static block_type generate(uint64_t seed, uint64_t stream, uint64_t offset)
+    {
+        block_type ctr = { uint32_t(offset), uint32_t(offset >> 32),
+                           uint32_t(stream), uint32_t(stream >> 32) };
+
+        uint32_t k0 = uint32_t(seed);
+        uint32_t k1 = uint32_t(seed >> 32);
+
+        for (int round=0; round<10; ++round)
+        {
+            if (round > 0)
+            {
+                k0 += 0x9E3779B9u;
+                k1 += 0xBB67AE85u;
+            }
+
+            const uint64_t p0 = uint64_t(0xD2511F53u) * ctr[0];
+            const uint64_t p1 = uint64_t(0xCD9E8D57u) * ctr[2];
+
+            ctr = { uint32_t(p1 >> 32) ^ ctr[1] ^ k0, uint32_t(p1),
+                    uint32_t(p0 >> 32) ^ ctr[3] ^ k1, uint32_t(p0) };
+        }
+
+        return ctr;
+    }
+
+    /** Move the generator to the start of block 'offset' of its stream */
+    void seek(uint64_t offset)
+    {
+        offset_ = offset;
+        index_ = 4;
+    }
+
+    /** Skip forward over 'n' 32-bit numbers */
+    void discard(uint64_t n)
+    {
+        const uint64_t pos = position() + n;
+        offset_ = pos / 4;
+        index_ = 4;
+
+        if (pos % 4 != 0)
+        {
+            buffer_ = block(offset_);
+            offset_ += 1;
+            index_ = int(pos % 4);
+        }
+    }
+
+    /** Return the next 32-bit random number from the stream. This
+        makes Philox4x32 usable with the <random> distributions */
+    result_type operator()()
+    {
+        if (index_ == 4)
+        {
+            buffer_ = block(offset_);
+            offset_ += 1;
+            index_ = 0;
+        }
+
+        return buffer_[index_++];
+    }
+
+    static constexpr result_type min()
+    {
+        return 0;
+    }
+
+    static constexpr result_type max()
+    {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    uint64_t seed() const
+    {
+        return seed_;
+    }
+
+    uint64_t stream() const
+    {
+        return stream_;
+    }
+
+private:
+    /** The number of 32-bit values already drawn from the stream */
+    uint64_t position() const
+    {
+        return (index_ == 4) ? 4*offset_ : 4*(offset_-1) + index_;
+    }
+
+    uint64_t seed_;
+    uint64_t stream_;
+    uint64_t offset_;
+    int index_;
+    block_type buffer_;
+};
+
+/** Convert a 32-bit random number into a float uniformly distributed
+    in [0,1). Only the top 24 bits are used, as that is all a float can
+    represent exactly */
+inline float to_unit_float(uint32_t x)
+{
+    return float(x >> 8) * (1.0f / 16777216.0f);
+}
+
+/** Convert two 32-bit random numbers into a double uniformly distributed
+    in [0,1), using 53 random bits */
+inline double to_unit_double(uint32_t hi, uint32_t lo)
+{
+    const uint64_t bits = (uint64_t(hi) << 21) ^ (uint64_t(lo) >> 11);
+    return double(bits) * (1.0 / 9007199254740992.0);
+}
+
+} // end of namespace part1
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef range_h
+#define range_h
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace part1
+{
+
+/** This is a non-owning view of 'n' contiguous values starting at 'ptr'.
+    Use it to pass raw arrays, or memory owned by R, to the part1
+    primitives without copying, e.g. map(func, view(REAL(x), n)) */
+template<class T>
+class View
+{
+public:
+    typedef T value_type;
+
+    View(T *_ptr, size_t _n) : ptr(_ptr), n(_n)
+    {}
+
+    T* data() const
+    {
+        return ptr;
+    }
+
+    size_t size() const
+    {
+        return n;
+    }
+
+    bool empty() const
+    {
+        return n == 0;
+    }
+
+    T& operator[](size_t i) const
+    {
+        return ptr[i];
+    }
+
+    T* begin() const
+    {
+        return ptr;
+    }
+
+    T* end() const
+    {
+        return ptr + n;
+    }
+
+private:
+    T *ptr;
+    size_t n;
+};
+
+template<class T>
+View<T> view(T *ptr, size_t n)
+{
+    return View<T>(ptr, n);
+}
+
+namespace detail
+{
+    template<int N>
+    struct priority : priority<N-1>
+    {};
+
+    template<>
+    struct priority<0>
+    {};
+
+    /** Return a pointer to the first element of a contiguous range.
+        This prefers .data() (std::vector, std::array, std::span, View),
+        then .memptr() (Armadillo), then a begin() that is already a
+        pointer (Rcpp vectors) */
+    template<class T, size_t N>
+    T* range_data(T (&arr)[N], priority<3>)
+    {
+        return arr;
+    }
+
+    template<class R>
+    auto range_data(R &r, priority<2>) -> decltype(r.data())
+    {
+        return r.data();
+    }
+
+    template<class R>
+    auto range_data(R &r, priority<1>) -> decltype(r.memptr())
+    {
+        return r.memptr();
+    }
+
+    template<class R>
+    auto range_data(R &r, priority<0>)
+        -> typename std::enable_if<std::is_pointer<decltype(r.begin())>::value,
+                                   decltype(r.begin())>::type
+    {
+        return r.begin();
+    }
+
+    template<class R>
+    auto range_data(R &r) -> decltype(range_data(r, priority<3>()))
+    {
+        return range_data(r, priority<3>());
+    }
+
+    /** Return the number of elements in a contiguous range */
+    template<class T, size_t N>
+    size_t range_size(T (&)[N], priority<1>)
+    {
+        return N;
+    }
+
+    template<class R>
+    auto range_size(const R &r, priority<1>) -> decltype(size_t(r.size()))
+    {
+        return r.size();
+    }
+
+    template<class R>
+    auto range_size(const R &r, priority<0>) -> decltype(size_t(r.n_elem))
+    {
+        return r.n_elem;
+    }
+
+    template<class R>
+    auto range_size(R &r) -> decltype(range_size(r, priority<1>()))
+    {
+        return range_size(r, priority<1>());
+    }
+
+    template<class R, class = void>
+    struct is_contiguous_range : std::false_type
+    {};
+
+    template<class R>
+    struct is_contiguous_range<R, decltype( (void)range_data(std::declval<R&>()),
+                                            (void)range_size(std::declval<R&>()) )>
+        : std::true_type
+    {};
+
+    template<class... RS>
+    struct all_contiguous_ranges : std::true_type
+    {};
+
+    template<class R, class... RS>
+    struct all_contiguous_ranges<R, RS...>
+        : std::integral_constant<bool, is_contiguous_range<R>::value &&
+                                       all_contiguous_ranges<RS...>::value>
+    {};
+
+    /** Used to constrain the part1 primitives to contiguous ranges */
+    template<class... RS>
+    using enable_if_ranges = typename std::enable_if<all_contiguous_ranges<RS...>::value>::type;
+
+    /** The (unqualified) type of the elements of a contiguous range */
+    template<class R>
+    using range_value_t = typename std::remove_cv<typename std::remove_pointer<
+                              decltype(range_data(std::declval<R&>()))>::type>::type;
+}
+
+} // end of namespace part1
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef runtime_h
+#define runtime_h
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <cstdlib>
+
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* The BLAS libraries that Armadillo and R link against each run their
+   own thread pool. These are declared weak so that the call is only
+   made if the library is actually loaded into the process */
+#if defined(__GNUC__) && !defined(_WIN32)
+extern "C"
+{
+    void openblas_set_num_threads(int) __attribute__((weak));
+    void MKL_Set_Num_Threads(int) __attribute__((weak));
+    void bli_thread_set_num_threads(long) __attribute__((weak));
+}
+#define PART1_HAVE_WEAK_BLAS 1
+#endif
+
+namespace part1
+{
+
+/** This namespace holds a single process-wide thread budget that is
+    shared by TBB, OpenMP and the BLAS library, so that code which mixes
+    them (e.g. TBB called from an R worker that already uses a threaded
+    BLAS) does not run more threads than there are cores */
+namespace runtime
+{
+
+namespace detail
+{
+    /** Return PART1_NUM_THREADS if set, else the number of cores TBB can use */
+    inline int initial_budget()
+    {
+        const char *env = std::getenv("PART1_NUM_THREADS");
+
+        if (env)
+        {
+            const int n = std::atoi(env);
+
+            if (n > 0)
+            {
+                return n;
+            }
+        }
+
+        return tbb::this_task_arena::max_concurrency();
+    }
+
+    struct State
+    {
+        State() : default_budget(initial_budget())
+        {}
+
+        std::mutex mutex;
+        int budget = 0;
+        int default_budget;
+        std::unique_ptr<tbb::global_control> control;
+        std::shared_ptr<tbb::task_arena> arena;
+    };
+
+    inline State& state()
+    {
+        static State s;
+        return s;
+    }
+
+    inline void set_env(const char *name, int value)
+    {
+#ifndef _WIN32
+        setenv(name, std::to_string(value).c_str(), 1);
+#endif
+    }
+}
+
+/** Return the number of threads to use if no budget has been set. This
+    is PART1_NUM_THREADS as it was when the process started (e.g. as
+    inherited from a parent process), else the number of cores */
+inline int default_budget()
+{
+    return detail::state().default_budget;
+}
+
+/** Set the total number of threads that may be used by TBB, OpenMP
+    and the BLAS library. A value <= 0 restores the default. The
+    environment variables read by these runtimes are also updated, so
+    that child processes (e.g. R parallel workers) inherit the budget */
+inline int set_thread_budget(int n)
+{
+    auto &s = detail::state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    if (n <= 0)
+    {
+        n = s.default_budget;
+    }
+
+    s.budget = n;
+
+    // the most restrictive global_control wins, so drop the old one first
+    s.control.reset();
+    s.control.reset( new tbb::global_control(tbb::global_control::max_allowed_parallelism, n) );
+    s.arena = std::make_shared<tbb::task_arena>(n);
+
+#ifdef _OPENMP
+    omp_set_num_threads(n);
+    // nested parallel regions would multiply the thread count
+    omp_set_max_active_levels(1);
+#endif
+
+#ifdef PART1_HAVE_WEAK_BLAS
+    if (openblas_set_num_threads) openblas_set_num_threads(n);
+    if (MKL_Set_Num_Threads) MKL_Set_Num_Threads(n);
+    if (bli_thread_set_num_threads) bli_thread_set_num_threads(n);
+#endif
+
+    detail::set_env("OMP_NUM_THREADS", n);
+    detail::set_env("OPENBLAS_NUM_THREADS", n);
+    detail::set_env("MKL_NUM_THREADS", n);
+    detail::set_env("RCPP_PARALLEL_NUM_THREADS", n);
+    detail::set_env("PART1_NUM_THREADS", n);
+
+    return n;
+}
+
+/** Return the current thread budget */
+inline int thread_budget()
+{
+    auto &s = detail::state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    return (s.budget > 0) ? s.budget : s.default_budget;
+}
+
+/** Run 'func' inside the task arena bounded by the thread budget. If
+    no budget has been set, 'func' is run in the calling thread's
+    current arena */
+template<class FUNC>
+auto execute(FUNC &&func) -> decltype(func())
+{
+    std::shared_ptr<tbb::task_arena> arena;
+
+    {
+        auto &s = detail::state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        arena = s.arena;
+    }
+
+    if (arena)
+    {
+        return arena->execute(func);
+    }
+    else
+    {
+        return func();
+    }
+}
+
+} // end of namespace runtime
+
+} // end of namespace part1
+
+#endif
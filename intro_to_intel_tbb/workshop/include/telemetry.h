@@ -0,0 +1,205 @@
+#ifndef telemetry_h
+#define telemetry_h
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <string>
+#include <atomic>
+#include <algorithm>
+
+#include <tbb/tick_count.h>
+#include <tbb/task_arena.h>
+#include <tbb/concurrent_vector.h>
+
+namespace part1
+{
+
+namespace telemetry
+{
+
+/** This records a single chunk of work executed by one worker */
+struct ChunkRecord
+{
+    int worker;
+    size_t begin, end;
+    tbb::tick_count start, stop;
+};
+
+/** This is a summary of the chunks recorded by a Recorder */
+struct Summary
+{
+    size_t nchunks = 0;
+    size_t nsteals = 0;
+    size_t nelements = 0;
+    size_t min_chunk = 0;
+    size_t max_chunk = 0;
+    double mean_chunk = 0;
+
+    /** Wall time between the first chunk starting and the last one finishing */
+    double wall_seconds = 0;
+
+    /** Time spent inside chunks, per worker id */
+    std::map<int, double> busy_seconds;
+
+    /** Busiest worker's busy time divided by the mean busy time
+        (1.0 means perfectly balanced) */
+    double imbalance = 0;
+};
+
+/** Pass a Recorder to a part1::parallel primitive to record the
+    wall time, worker id and number of elements of every chunk that
+    it executes. Recording is thread-safe, and a Recorder can be
+    reused for several calls */
+class Recorder
+{
+public:
+    static constexpr bool enabled = true;
+
+    Recorder() : origin(tbb::tick_count::now()), nsteals(0)
+    {}
+
+    void record_chunk(size_t begin, size_t end,
+                      tbb::tick_count start, tbb::tick_count stop)
+    {
+        chunks.push_back( ChunkRecord{ tbb::this_task_arena::current_thread_index(),
+                                       begin, end, start, stop } );
+    }
+
+    /** Called whenever TBB splits a reduction body, which it does
+        only when a subrange is stolen by another worker */
+    void record_steal()
+    {
+        nsteals.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void clear()
+    {
+        chunks.clear();
+        nsteals = 0;
+        origin = tbb::tick_count::now();
+    }
+
+    std::vector<ChunkRecord> records() const
+    {
+        return std::vector<ChunkRecord>(chunks.begin(), chunks.end());
+    }
+
+    Summary summary() const
+    {
+        Summary s;
+
+        s.nchunks = chunks.size();
+        s.nsteals = nsteals.load();
+
+        if (chunks.empty())
+        {
+            return s;
+        }
+
+        s.min_chunk = chunks[0].end - chunks[0].begin;
+        tbb::tick_count first = chunks[0].start;
+        tbb::tick_count last = chunks[0].stop;
+
+        for (const ChunkRecord &chunk : chunks)
+        {
+            const size_t n = chunk.end - chunk.begin;
+
+            s.nelements += n;
+            s.min_chunk = std::min(s.min_chunk, n);
+            s.max_chunk = std::max(s.max_chunk, n);
+            s.busy_seconds[chunk.worker] += (chunk.stop - chunk.start).seconds();
+
+            if ((chunk.start - first).seconds() < 0) first = chunk.start;
+            if ((chunk.stop - last).seconds() > 0) last = chunk.stop;
+        }
+
+        s.mean_chunk = double(s.nelements) / s.nchunks;
+        s.wall_seconds = (last - first).seconds();
+
+        double total_busy = 0;
+        double max_busy = 0;
+
+        for (const auto &worker : s.busy_seconds)
+        {
+            total_busy += worker.second;
+            max_busy = std::max(max_busy, worker.second);
+        }
+
+        const double mean_busy = total_busy / s.busy_seconds.size();
+        s.imbalance = (mean_busy > 0) ? max_busy / mean_busy : 1.0;
+
+        return s;
+    }
+
+    void print_summary(std::ostream &os=std::cout) const
+    {
+        const Summary s = summary();
+
+        os << "chunks: " << s.nchunks << " (" << s.nelements << " elements, size min/mean/max "
+           << s.min_chunk << "/" << s.mean_chunk << "/" << s.max_chunk << ")\n"
+           << "steals: " << s.nsteals << "\n"
+           << "wall time: " << s.wall_seconds << " s, imbalance: " << s.imbalance << "\n";
+
+        for (const auto &worker : s.busy_seconds)
+        {
+            os << "  worker " << worker.first << " busy for " << worker.second << " s\n";
+        }
+    }
+
+    /** Write the recorded chunks as a Chrome trace file, which can be
+        viewed in chrome://tracing or https://ui.perfetto.dev */
+    void write_chrome_trace(const std::string &filename) const
+    {
+        std::ofstream file( filename );
+
+        // times are in microseconds, so keep them to the nanosecond
+        file << std::fixed << std::setprecision(3);
+
+        file << "{\"traceEvents\":[";
+
+        bool first = true;
+
+        for (const ChunkRecord &chunk : chunks)
+        {
+            file << (first ? "\n" : ",\n")
+                 << "{\"name\":\"chunk\",\"ph\":\"X\",\"pid\":0,\"tid\":" << chunk.worker
+                 << ",\"ts\":" << 1e6 * (chunk.start - origin).seconds()
+                 << ",\"dur\":" << 1e6 * (chunk.stop - chunk.start).seconds()
+                 << ",\"args\":{\"begin\":" << chunk.begin << ",\"end\":" << chunk.end
+                 << ",\"elements\":" << (chunk.end - chunk.begin) << "}}";
+
+            first = false;
+        }
+
+        file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+
+private:
+    tbb::tick_count origin;
+    tbb::concurrent_vector<ChunkRecord> chunks;
+    std::atomic<size_t> nsteals;
+};
+
+/** This is the recorder used when telemetry is not requested. Every
+    call is empty and 'enabled' is false, so the compiler removes all
+    of the instrumentation */
+class NullRecorder
+{
+public:
+    static constexpr bool enabled = false;
+
+    void record_chunk(size_t, size_t, tbb::tick_count, tbb::tick_count)
+    {}
+
+    void record_steal()
+    {}
+};
+
+} // end of namespace telemetry
+
+} // end of namespace part1
+
+#endif
@@ -0,0 +1,321 @@
+#ifndef wordcount_h
+#define wordcount_h
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+
+#include "filecounter.h"
+
+namespace wordcount
+{
+
+/** The number of times each word occurs */
+typedef std::unordered_map<std::string, size_t> WordCounts;
+
+/** A word and the number of times it occurs */
+typedef std::pair<std::string, size_t> WordCount;
+
+namespace detail
+{
+    inline bool is_word_char(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '\'';
+    }
+
+    inline char to_lower(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+    }
+
+    /** Call 'func(word, line)' on every word in the 'n' bytes at 'data',
+        where 'line' is the (1-based) line on which the word appears. A word
+        is a run of letters and apostrophes, with any leading or trailing
+        apostrophes removed ('tis -> tis), and is converted to lower case.
+        The string passed to 'func' is reused between calls */
+    template<class FUNC>
+    void for_each_word_and_line(const char *data, size_t n, FUNC func)
+    {
+        std::string word;
+
+        size_t line = 1;
+        size_t i = 0;
+
+        while (i < n)
+        {
+            while (i < n && !is_word_char(data[i]))
+            {
+                if (data[i] == '\n') ++line;
+                ++i;
+            }
+
+            size_t start = i;
+            while (i < n && is_word_char(data[i])) ++i;
+            size_t end = i;
+
+            while (start < end && data[start] == '\'') ++start;
+            while (end > start && data[end-1] == '\'') --end;
+
+            if (start < end)
+            {
+                word.assign(data + start, end - start);
+                std::transform(word.begin(), word.end(), word.begin(), to_lower);
+                func(word, line);
+            }
+        }
+    }
+
+    /** Call 'func(word)' on every word in the 'n' bytes at 'data' */
+    template<class FUNC>
+    void for_each_word(const char *data, size_t n, FUNC func)
+    {
+        for_each_word_and_line(data, n, [&](const std::string &word, size_t)
+        {
+            func(word);
+        });
+    }
+
+    /** Return the end of the chunk that starts at 'begin' and is about
+        'chunk_size' bytes long, moved forward so that no word is split */
+    inline size_t chunk_end(const char *data, size_t n, size_t begin, size_t chunk_size)
+    {
+        size_t end = std::min(n, begin + chunk_size);
+
+        while (end < n && is_word_char(data[end]))
+        {
+            ++end;
+        }
+
+        return end;
+    }
+
+    /** This holds the text of a file, either mapped or read into memory */
+    class FileText
+    {
+    public:
+        explicit FileText(const std::string &filename)
+            : data(nullptr), size(0)
+        {
+#ifdef FILECOUNTER_HAVE_MMAP
+            mapped.reset( new filecounter::detail::MappedFile(filename) );
+
+            if (mapped->data)
+            {
+                data = mapped->data;
+                size = mapped->size;
+                return;
+            }
+#endif
+            std::ifstream file( filename, std::ios::binary );
+            std::stringstream buffer;
+            buffer << file.rdbuf();
+            text = buffer.str();
+
+            data = text.data();
+            size = text.size();
+        }
+
+        const char *data;
+        size_t size;
+
+    private:
+#ifdef FILECOUNTER_HAVE_MMAP
+        std::unique_ptr<filecounter::detail::MappedFile> mapped;
+#endif
+        std::string text;
+    };
+
+    /** Word counts split into shards by the hash of the word, so that
+        shards can be merged independently */
+    typedef std::vector<WordCounts> ShardedCounts;
+}
+
+/** Count the words in the file called 'filename' */
+inline WordCounts count_words(const std::string &filename)
+{
+    WordCounts counts;
+
+    detail::FileText text( filename );
+
+    detail::for_each_word(text.data, text.size, [&](const std::string &word)
+    {
+        counts[word] += 1;
+    });
+
+    return counts;
+}
+
+/** Count the words in all of the passed files */
+inline WordCounts count_words(const std::vector<std::string> &filenames)
+{
+    WordCounts counts;
+
+    for (const std::string &filename : filenames)
+    {
+        for (const auto &item : count_words(filename))
+        {
+            counts[item.first] += item.second;
+        }
+    }
+
+    return counts;
+}
+
+/** Return the 'k' most common words in 'counts', most common first.
+    Words with equal counts are sorted alphabetically */
+inline std::vector<WordCount> top_k(const WordCounts &counts, size_t k)
+{
+    std::vector<WordCount> words(counts.begin(), counts.end());
+
+    k = std::min(k, words.size());
+
+    std::partial_sort(words.begin(), words.begin() + k, words.end(),
+                      [](const WordCount &a, const WordCount &b)
+    {
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    });
+
+    words.resize(k);
+
+    return words;
+}
+
+namespace detail
+{
+    /** Count the words in all of the passed files in parallel. Each file is
+        cut into chunks of about 'chunk_size' bytes (never splitting a word),
+        and each chunk is tokenised into the calling thread's own sharded hash
+        map. The thread-local maps are then merged shard by shard in parallel */
+    inline ShardedCounts count_words_sharded(const std::vector<std::string> &filenames,
+                                             size_t chunk_size, size_t nshards)
+    {
+        struct Chunk
+        {
+            const char *data;
+            size_t size;
+        };
+
+        std::vector<std::unique_ptr<FileText>> texts(filenames.size());
+
+        tbb::parallel_for( size_t(0), filenames.size(), [&](size_t i)
+        {
+            texts[i].reset( new FileText(filenames[i]) );
+        });
+
+        std::vector<Chunk> chunks;
+
+        for (const auto &text : texts)
+        {
+            size_t begin = 0;
+
+            while (begin < text->size)
+            {
+                const size_t end = chunk_end(text->data, text->size, begin, chunk_size);
+                chunks.push_back( Chunk{ text->data + begin, end - begin } );
+                begin = end;
+            }
+        }
+
+        tbb::enumerable_thread_specific<ShardedCounts> local_counts(
+                                            [&](){ return ShardedCounts(nshards); });
+
+        std::hash<std::string> hasher;
+
+        tbb::parallel_for( tbb::blocked_range<size_t>(0, chunks.size()),
+                           [&](const tbb::blocked_range<size_t> &r)
+        {
+            ShardedCounts &shards = local_counts.local();
+
+            for (size_t i=r.begin(); i<r.end(); ++i)
+            {
+                for_each_word(chunks[i].data, chunks[i].size, [&](const std::string &word)
+                {
+                    shards[hasher(word) % nshards][word] += 1;
+                });
+            }
+        });
+
+        ShardedCounts merged(nshards);
+
+        tbb::parallel_for( size_t(0), nshards, [&](size_t s)
+        {
+            for (ShardedCounts &shards : local_counts)
+            {
+                for (const auto &item : shards[s])
+                {
+                    merged[s][item.first] += item.second;
+                }
+            }
+        });
+
+        return merged;
+    }
+}
+
+namespace parallel
+{
+
+/** Count the words in all of the passed files in parallel */
+inline WordCounts count_words(const std::vector<std::string> &filenames,
+                              size_t chunk_size=256*1024, size_t nshards=64)
+{
+    detail::ShardedCounts shards = detail::count_words_sharded(filenames, chunk_size, nshards);
+
+    size_t nwords = 0;
+
+    for (const WordCounts &shard : shards)
+    {
+        nwords += shard.size();
+    }
+
+    WordCounts counts;
+    counts.reserve(nwords);
+
+    for (const WordCounts &shard : shards)
+    {
+        counts.insert(shard.begin(), shard.end());
+    }
+
+    return counts;
+}
+
+/** Return the 'k' most common words in all of the passed files, most
+    common first. The top 'k' of each shard is found in parallel, and
+    these candidates are then sorted to give the overall top 'k' */
+inline std::vector<WordCount> top_k(const std::vector<std::string> &filenames, size_t k,
+                                    size_t chunk_size=256*1024, size_t nshards=64)
+{
+    detail::ShardedCounts shards = detail::count_words_sharded(filenames, chunk_size, nshards);
+
+    std::vector<std::vector<WordCount>> candidates(nshards);
+
+    tbb::parallel_for( size_t(0), nshards, [&](size_t s)
+    {
+        candidates[s] = wordcount::top_k(shards[s], k);
+    });
+
+    WordCounts best;
+
+    for (const auto &shard : candidates)
+    {
+        best.insert(shard.begin(), shard.end());
+    }
+
+    return wordcount::top_k(best, k);
+}
+
+} // end of namespace parallel
+
+} // end of namespace wordcount
+
+#endif
@@ -0,0 +1,25 @@
+#include "lineindex.h"
+
+using namespace filecounter;
+
+int main(int argc, char **argv)
+{
+  // usage: linecache filename [line_number ...]
+  auto args = get_arguments(argc, argv);
+
+  if (args.empty())
+  {
+    std::cout << "usage: linecache filename [line_number ...]" << std::endl;
+    return 1;
+  }
+
+  std::cout << args[0] << " has " << cached_count_lines(args[0]) << " lines." << std::endl;
+
+  for (int i = 1; i < args.size(); i++)
+  {
+    size_t n = std::stoul(args[i]);
+    std::cout << n << ": " << get_line(args[0], n) << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,24 @@
+#include "part1.h"
+
+using namespace part1;
+
+int main(int argc, char **argv)
+{
+    // Calculate the total distance between pairs of random points,
+    // recording how tbb::parallel_reduce schedules the work
+    auto a = parallel::create_random_points(10000000, 50.0, 1);
+    auto b = parallel::create_random_points(10000000, 50.0, 2);
+
+    telemetry::Recorder recorder;
+
+    auto total = parallel::mapReduce( recorder, calc_distance, std::plus<float>(), a, b );
+
+    std::cout << "Total distance: " << total << std::endl;
+
+    recorder.print_summary();
+    recorder.write_chrome_trace("mapreduce_trace.json");
+
+    std::cout << "Trace written to mapreduce_trace.json" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include "invindex.h"
+#include "lineindex.h"
+
+using namespace invindex;
+
+int main(int argc, char **argv)
+{
+    // usage: search index_file "a phrase" [file1 file2 ...]
+    //
+    // If files are given, they are indexed (in parallel) and the index is
+    // saved to index_file, otherwise the saved index is used. The line
+    // indexes used to print the matching lines are kept in the directory
+    // index_file.lines, rather than beside the documents
+    auto args = filecounter::get_arguments(argc, argv);
+
+    if (args.size() < 2)
+    {
+        std::cout << "usage: search index_file \"a phrase\" [file1 file2 ...]" << std::endl;
+        return 1;
+    }
+
+    const std::string index_file = args[0];
+    const std::string phrase = args[1];
+
+    filecounter::index_directory() = index_file + ".lines";
+
+    if (args.size() > 2)
+    {
+        IndexBuilder builder( std::vector<std::string>(args.begin() + 2, args.end()) );
+
+        if (!builder.save(index_file))
+        {
+            std::cout << "could not write " << index_file << std::endl;
+            return 1;
+        }
+    }
+
+    MappedIndex index( index_file );
+
+    if (!index.valid())
+    {
+        std::cout << "could not read " << index_file << std::endl;
+        return 1;
+    }
+
+    auto hits = index.search(phrase);
+
+    for (const auto &hit : hits)
+    {
+        const std::string doc = index.doc_name(hit.doc);
+
+        std::cout << doc << ":" << hit.line << ": "
+                  << filecounter::get_line(doc, hit.line - 1) << std::endl;
+    }
+
+    std::cout << hits.size() << " matches" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "invindex.h"
+#include <tbb/tick_count.h>
+#include <tbb/global_control.h>
+#include <tbb/info.h>
+
+using namespace invindex;
+
+// Times building an inverted index of the files passed on the command
+// line, and then searching it for some phrases, e.g.
+// ./search_benchmark shakespeare/*
+int main(int argc, char **argv)
+{
+    auto filenames = filecounter::get_arguments(argc, argv);
+
+    if (filenames.empty())
+    {
+        std::cout << "usage: search_benchmark file1 file2 ..." << std::endl;
+        return 1;
+    }
+
+    const int nrepeats = 5;
+    const std::string index_file = "search_benchmark.invx";
+
+    // find the best of 'nrepeats' runs of 'func'
+    auto best_time = [&](auto func)
+    {
+        double best = 1e30;
+
+        for (int i = 0; i < nrepeats; i++)
+        {
+            auto start = tbb::tick_count::now();
+            func();
+            best = std::min(best, (tbb::tick_count::now() - start).seconds());
+        }
+
+        return best;
+    };
+
+    double serial = 0;
+
+    for (int nthreads = 1; nthreads <= tbb::info::default_concurrency(); nthreads *= 2)
+    {
+        tbb::global_control control(tbb::global_control::max_allowed_parallelism, nthreads);
+
+        double t = best_time([&]()
+        {
+            IndexBuilder builder( filenames );
+            builder.save(index_file);
+        });
+
+        if (nthreads == 1)
+        {
+            serial = t;
+        }
+
+        std::cout << "build (" << nthreads << " threads): " << t << " s, speedup "
+                  << serial / t << std::endl;
+    }
+
+    MappedIndex index( index_file );
+
+    std::cout << index.ndocs() << " documents, " << index.nterms() << " words" << std::endl;
+
+    const std::vector<std::string> phrases = { "to be or not to be", "the king",
+                                               "wherefore art thou", "i do not know",
+                                               "exit" };
+
+    const int nqueries = 100;
+
+    for (const auto &phrase : phrases)
+    {
+        size_t nhits = 0;
+
+        double t = best_time([&]()
+        {
+            for (int i = 0; i < nqueries; i++)
+            {
+                nhits = index.search(phrase).size();
+            }
+        });
+
+        std::cout << "\"" << phrase << "\": " << nhits << " matches, "
+                  << 1e6 * t / nqueries << " us per query" << std::endl;
+    }
+
+    std::remove(index_file.c_str());
+
+    return 0;
+}
@@ -0,0 +1,25 @@
+// Expose the part1 thread budget to R. Load it with
+//
+//   Rcpp::sourceCpp("thread_budget.cpp")
+//   set_thread_budget(4)
+//
+// after which TBB, OpenMP and the BLAS library in the R session (and
+// any workers it starts) share a budget of 4 threads.
+
+// [[Rcpp::depends(RcppParallel)]]
+// [[Rcpp::plugins(cpp14)]]
+// [[Rcpp::plugins(openmp)]]
+#include <Rcpp.h>
+#include "include/runtime.h"
+
+// [[Rcpp::export]]
+int set_thread_budget(int n)
+{
+  return part1::runtime::set_thread_budget(n);
+}
+
+// [[Rcpp::export]]
+int thread_budget()
+{
+  return part1::runtime::thread_budget();
+}
@@ -0,0 +1,26 @@
+#include "wordcount.h"
+
+using namespace wordcount;
+
+int main(int argc, char **argv)
+{
+    // usage: wordfreq [-k number_of_words] file1 file2 ...
+    size_t k = 20;
+
+    auto filenames = filecounter::get_arguments(argc, argv);
+
+    if (filenames.size() >= 2 && filenames[0] == "-k")
+    {
+        k = std::stoul(filenames[1]);
+        filenames.erase(filenames.begin(), filenames.begin() + 2);
+    }
+
+    auto words = parallel::top_k(filenames, k);
+
+    for (size_t i = 0; i < words.size(); i++)
+    {
+        std::cout << i+1 << ". " << words[i].first << " (" << words[i].second << ")" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "wordcount.h"
+#include <tbb/tick_count.h>
+#include <tbb/global_control.h>
+#include <tbb/info.h>
+
+using namespace wordcount;
+
+// Times the serial and parallel word counts over the files passed on
+// the command line, e.g. ./wordfreq_benchmark shakespeare/*
+int main(int argc, char **argv)
+{
+    auto filenames = filecounter::get_arguments(argc, argv);
+
+    if (filenames.empty())
+    {
+        std::cout << "usage: wordfreq_benchmark file1 file2 ..." << std::endl;
+        return 1;
+    }
+
+    const int nrepeats = 5;
+    const size_t k = 10;
+
+    // find the best of 'nrepeats' runs of 'func'
+    auto best_time = [&](auto func)
+    {
+        double best = 1e30;
+
+        for (int i = 0; i < nrepeats; i++)
+        {
+            auto start = tbb::tick_count::now();
+            func();
+            best = std::min(best, (tbb::tick_count::now() - start).seconds());
+        }
+
+        return best;
+    };
+
+    std::vector<WordCount> serial_words;
+
+    double serial = best_time([&]()
+    {
+        serial_words = top_k(count_words(filenames), k);
+    });
+
+    std::cout << "serial: " << serial << " s" << std::endl;
+
+    for (int nthreads = 1; nthreads <= tbb::info::default_concurrency(); nthreads *= 2)
+    {
+        tbb::global_control control(tbb::global_control::max_allowed_parallelism, nthreads);
+
+        std::vector<WordCount> parallel_words;
+
+        double t = best_time([&]()
+        {
+            parallel_words = parallel::top_k(filenames, k);
+        });
+
+        std::cout << "parallel (" << nthreads << " threads): " << t << " s, speedup "
+                  << serial / t << (parallel_words == serial_words ? "" : " MISMATCH")
+                  << std::endl;
+    }
+
+    for (const auto &word : serial_words)
+    {
+        std::cout << word.first << " " << word.second << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <cmath>
+#include <string>
+#include <iostream>
+#include <omp.h>
+
+#include "montecarlo.h"
+
+// Uses the Monte Carlo integration engine in montecarlo.h to estimate pi
+// (as in pi_estimate.cpp) and a 6-dimensional Gaussian integral, each to a
+// requested standard error, using either pseudo-random points or
+// scrambled Sobol points (quasi-Monte Carlo).
+//
+// Compile with
+//   g++ -O3 -fopenmp -I../intro_to_intel_tbb/workshop/include mc_integrate.cpp
+// usage: mc_integrate [random|sobol] [target_standard_error]
+
+void report(const std::string &name, const montecarlo::Result &result, double exact, double seconds)
+{
+    std::cout.precision(10);
+    std::cout << name << ": " << result.estimate << " +/- " << result.std_error
+              << " (exact " << exact << ", error " << result.estimate - exact << ")" << std::endl;
+
+    std::cout.precision(4);
+    std::cout << "    " << result.n_samples << " samples in " << seconds << " s"
+              << (result.converged ? "" : " - did not reach the target error") << std::endl;
+}
+
+int main(int argc, char **argv) {
+
+    montecarlo::Options options;
+
+    const std::string method = (argc > 1) ? argv[1] : "random";
+    options.method = (method == "sobol") ? montecarlo::Method::Sobol
+                                         : montecarlo::Method::PseudoRandom;
+    options.target_error = (argc > 2) ? std::stod(argv[2]) : 1e-4;
+
+    std::cout << "Using " << omp_get_max_threads() << " threads, "
+              << ((method == "sobol") ? "scrambled Sobol" : "pseudo-random")
+              << " points, target standard error " << options.target_error << std::endl;
+
+    // pi is the area of the unit circle, i.e. the integral over [-1,1]^2
+    // of 1 inside the circle and 0 outside
+    double start = omp_get_wtime();
+
+    auto pi = montecarlo::integrate([](const double *x)
+    {
+        return (x[0]*x[0] + x[1]*x[1] <= 1.0) ? 1.0 : 0.0;
+    }, montecarlo::Box::cube(2, -1.0, 1.0), options);
+
+    report("pi", pi, M_PI, omp_get_wtime() - start);
+
+    // the integral of exp(-|x|^2) over [0,1]^6 is (sqrt(pi)/2 erf(1))^6
+    const int d = 6;
+
+    start = omp_get_wtime();
+
+    auto gaussian = montecarlo::integrate([](const double *x)
+    {
+        double r2 = 0.0;
+
+        for (int j = 0; j < d; j++)
+        {
+            r2 += x[j] * x[j];
+        }
+
+        return std::exp(-r2);
+    }, montecarlo::Box::cube(d, 0.0, 1.0), options);
+
+    report("gaussian", gaussian, std::pow(0.5 * std::sqrt(M_PI) * std::erf(1.0), d),
+           omp_get_wtime() - start);
+
+    return 0;
+}
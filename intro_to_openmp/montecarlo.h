@@ -0,0 +1,490 @@
+#ifndef montecarlo_h
+#define montecarlo_h
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <omp.h>
+
+// The counter-based random number generator from the TBB workshop.
+// Compile with -I../intro_to_intel_tbb/workshop/include
+#include "philox.h"
+
+namespace montecarlo
+{
+
+// A d-dimensional box [lower[0],upper[0]] x ... x [lower[d-1],upper[d-1]]
+struct Box
+{
+    std::vector<double> lower;
+    std::vector<double> upper;
+
+    Box(std::vector<double> lower_, std::vector<double> upper_)
+        : lower(lower_), upper(upper_)
+    {
+        if (lower.size() != upper.size() || lower.empty())
+        {
+            throw std::invalid_argument("montecarlo::Box: lower and upper must have the same, non-zero size");
+        }
+    }
+
+    // The box [lo,hi]^d
+    static Box cube(size_t d, double lo, double hi)
+    {
+        return Box(std::vector<double>(d, lo), std::vector<double>(d, hi));
+    }
+
+    size_t dimension() const
+    {
+        return lower.size();
+    }
+
+    double volume() const
+    {
+        double v = 1.0;
+
+        for (size_t i = 0; i < lower.size(); i++)
+        {
+            v *= upper[i] - lower[i];
+        }
+
+        return v;
+    }
+};
+
+// How the points are chosen
+enum class Method
+{
+    // independent uniform random points
+    PseudoRandom,
+
+    // randomised quasi-Monte Carlo: independently scrambled replicates of
+    // a Sobol low-discrepancy sequence (see integrate)
+    Sobol
+};
+
+// Controls how points are chosen and when the integration stops
+struct Options
+{
+    Method method = Method::PseudoRandom;
+
+    // stop once the standard error of the estimate is at most this
+    double target_error = 1e-3;
+
+    // never use fewer than this many samples, so that the variance
+    // estimate is sensible before it is used to decide to stop
+    uint64_t min_samples = 100000;
+
+    // give up (with converged = false) after this many samples
+    uint64_t max_samples = uint64_t(1) << 40;
+
+    // the number of samples in each block of pseudo-random points, which
+    // all come from one Philox stream (Method::PseudoRandom only)
+    uint64_t batch_size = 1 << 16;
+
+    // the number of independently scrambled Sobol sequences, whose
+    // spread gives the standard error (Method::Sobol only)
+    int n_replicates = 16;
+
+    uint64_t seed = 42;
+};
+
+struct Result
+{
+    double estimate;
+    double std_error;
+    uint64_t n_samples;
+    bool converged;
+};
+
+// Running mean and variance of a stream of values, using Welford's
+// algorithm, which does not lose precision when the mean is large
+struct RunningStats
+{
+    uint64_t n = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+
+    void add(double x)
+    {
+        n += 1;
+        const double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+    }
+
+    // Combine with the statistics of another set of values (Chan et al.)
+    void merge(const RunningStats &other)
+    {
+        if (other.n == 0)
+        {
+            return;
+        }
+
+        const uint64_t total = n + other.n;
+        const double delta = other.mean - mean;
+
+        mean += delta * other.n / total;
+        m2 += other.m2 + delta * delta * (double(n) * other.n / total);
+        n = total;
+    }
+
+    double variance() const
+    {
+        return (n > 1) ? m2 / (n - 1) : std::numeric_limits<double>::infinity();
+    }
+};
+
+namespace detail
+{
+    // Plain Monte Carlo. The points are drawn in blocks of
+    // options.batch_size, and block b takes its points from Philox stream b,
+    // so every point is the same whichever thread draws it. Each round
+    // works through a run of blocks in parallel, keeping statistics per
+    // block, and then merges them in block order, so the result only
+    // depends on the seed and the options, not on the number of threads.
+    // The first round has enough blocks for options.min_samples, and each
+    // later round doubles the number of blocks done, until the standard
+    // error is small enough
+    template<class FUNC>
+    Result integrate_random(FUNC f, const Box &box, const Options &options)
+    {
+        const size_t d = box.dimension();
+        const double volume = box.volume();
+
+        const uint64_t block_size = std::max<uint64_t>(options.batch_size, 1);
+        const uint64_t max_blocks = std::max<uint64_t>(1, (options.max_samples + block_size - 1) / block_size);
+
+        uint64_t n_blocks = 0;
+        uint64_t round_blocks = std::max<uint64_t>(1, (options.min_samples + block_size - 1) / block_size);
+
+        std::vector<RunningStats> block_stats;
+        RunningStats total;
+
+        Result result;
+        result.converged = false;
+
+        while (true)
+        {
+            const uint64_t first = n_blocks;
+            const uint64_t last = std::min(n_blocks + round_blocks, max_blocks);
+
+            block_stats.assign(last - first, RunningStats());
+
+            #pragma omp parallel
+            {
+                std::vector<double> x(d);
+
+                #pragma omp for schedule(dynamic)
+                for (uint64_t b = first; b < last; b++)
+                {
+                    part1::Philox4x32 generator(options.seed, b);
+                    RunningStats &stats = block_stats[b - first];
+
+                    for (uint64_t i = 0; i < block_size; i++)
+                    {
+                        for (size_t j = 0; j < d; j++)
+                        {
+                            // draw the words one at a time, as the order in
+                            // which function arguments are evaluated varies
+                            const uint32_t hi = generator();
+                            const uint32_t lo = generator();
+                            const double u = part1::to_unit_double(hi, lo);
+                            x[j] = box.lower[j] + u * (box.upper[j] - box.lower[j]);
+                        }
+
+                        stats.add(f(x.data()));
+                    }
+                }
+            }
+
+            // merge in block order, whichever threads did the blocks
+            for (const RunningStats &stats : block_stats)
+            {
+                total.merge(stats);
+            }
+
+            n_blocks = last;
+
+            result.estimate = volume * total.mean;
+            result.std_error = volume * std::sqrt(total.variance() / total.n);
+            result.n_samples = total.n;
+
+            if (total.n >= options.min_samples && result.std_error <= options.target_error)
+            {
+                result.converged = true;
+                break;
+            }
+
+            if (n_blocks >= max_blocks)
+            {
+                break;
+            }
+
+            round_blocks = n_blocks;
+        }
+
+        return result;
+    }
+
+    // Direction numbers for the first 16 dimensions of the Sobol sequence
+    // (Joe and Kuo, new-joe-kuo-6.21201). Each row is the degree s, the
+    // coefficients a of the primitive polynomial and the initial m values.
+    // The first dimension is the van der Corput sequence and needs none
+    const int sobol_max_dimension = 16;
+
+    struct SobolPolynomial
+    {
+        int s;
+        uint32_t a;
+        uint32_t m[6];
+    };
+
+    const SobolPolynomial sobol_polynomials[sobol_max_dimension - 1] = {
+        { 1,  0, { 1 } },
+        { 2,  1, { 1, 3 } },
+        { 3,  1, { 1, 3, 1 } },
+        { 3,  2, { 1, 1, 1 } },
+        { 4,  1, { 1, 1, 3, 3 } },
+        { 4,  4, { 1, 3, 5, 13 } },
+        { 5,  2, { 1, 1, 5, 5, 17 } },
+        { 5,  4, { 1, 1, 5, 5, 5 } },
+        { 5,  7, { 1, 1, 7, 11, 19 } },
+        { 5, 11, { 1, 1, 5, 1, 1 } },
+        { 5, 13, { 1, 1, 1, 3, 11 } },
+        { 5, 14, { 1, 3, 5, 5, 31 } },
+        { 6,  1, { 1, 3, 3, 9, 7, 49 } },
+        { 6, 13, { 1, 1, 1, 15, 21, 21 } },
+        { 6, 16, { 1, 3, 1, 13, 27, 49 } }
+    };
+
+    // The 32 direction numbers of each of the first 'd' dimensions,
+    // stored as v[32*dimension + bit]
+    inline std::vector<uint32_t> sobol_directions(size_t d)
+    {
+        if (d > size_t(sobol_max_dimension))
+        {
+            throw std::invalid_argument("montecarlo: Sobol points are only available in up to 16 dimensions");
+        }
+
+        std::vector<uint32_t> v(32 * d);
+
+        for (int k = 0; k < 32; k++)
+        {
+            v[k] = uint32_t(1) << (31 - k);
+        }
+
+        for (size_t j = 1; j < d; j++)
+        {
+            const SobolPolynomial &p = sobol_polynomials[j - 1];
+            uint32_t *vj = &v[32 * j];
+
+            for (int k = 0; k < 32; k++)
+            {
+                if (k < p.s)
+                {
+                    vj[k] = p.m[k] << (31 - k);
+                }
+                else
+                {
+                    vj[k] = vj[k - p.s] ^ (vj[k - p.s] >> p.s);
+
+                    for (int i = 1; i < p.s; i++)
+                    {
+                        if ((p.a >> (p.s - 1 - i)) & 1)
+                        {
+                            vj[k] ^= vj[k - i];
+                        }
+                    }
+                }
+            }
+        }
+
+        return v;
+    }
+
+    inline uint32_t reverse_bits(uint32_t x)
+    {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+        x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // Owen (nested uniform) scrambling of one coordinate, using the
+    // hash-based permutation of Laine and Karras as adapted by Burley
+    // (2020). Every bit is flipped depending on all of the bits above
+    // it, so the scrambled points keep the sequence's equidistribution
+    inline uint32_t owen_scramble(uint32_t x, uint32_t seed)
+    {
+        x = reverse_bits(x);
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return reverse_bits(x);
+    }
+
+    // The number of consecutive Sobol points summed together. The points
+    // of a replicate are always a multiple of this
+    const uint64_t sobol_block_size = 1024;
+
+    // Randomised quasi-Monte Carlo. Each replicate scrambles the first n
+    // points of the Sobol sequence with its own seeds. The points are split
+    // into blocks by sequence index, which are shared between the OpenMP
+    // threads: each block works out its first point directly, then steps
+    // through the block in Gray code order, which changes one direction
+    // number per point. The replicate estimates are independent and unbiased, so their
+    // mean is the estimate and their spread gives the standard error. The
+    // number of points is doubled until the error is small enough
+    template<class FUNC>
+    Result integrate_sobol(FUNC f, const Box &box, const Options &options)
+    {
+        const size_t d = box.dimension();
+        const double volume = box.volume();
+        const int n_replicates = std::max(options.n_replicates, 2);
+
+        const std::vector<uint32_t> v = sobol_directions(d);
+
+        uint64_t n = sobol_block_size;
+
+        while (n * n_replicates < options.min_samples)
+        {
+            n *= 2;
+        }
+
+        Result result;
+        result.converged = false;
+
+        while (true)
+        {
+            RunningStats replicates;
+
+            for (int r = 0; r < n_replicates; r++)
+            {
+                std::vector<uint32_t> seeds(d);
+                part1::Philox4x32 generator(options.seed, r);
+
+                for (size_t j = 0; j < d; j++)
+                {
+                    seeds[j] = generator();
+                }
+
+                // sum the points a block at a time, and add up the block
+                // sums in order, so the total is the same for any number
+                // of threads (n is a multiple of the block size)
+                const uint64_t n_blocks = n / sobol_block_size;
+                std::vector<double> block_sums(n_blocks);
+
+                #pragma omp parallel
+                {
+                    std::vector<uint32_t> point(d);
+                    std::vector<double> x(d);
+
+                    #pragma omp for schedule(static)
+                    for (uint64_t b = 0; b < n_blocks; b++)
+                    {
+                        const uint64_t first = b * sobol_block_size;
+                        const uint64_t last = first + sobol_block_size;
+
+                        // work out the first point of the block directly
+                        const uint64_t gray = first ^ (first >> 1);
+
+                        std::fill(point.begin(), point.end(), 0);
+
+                        for (int k = 0; k < 32; k++)
+                        {
+                            if ((gray >> k) & 1)
+                            {
+                                for (size_t j = 0; j < d; j++)
+                                {
+                                    point[j] ^= v[32*j + k];
+                                }
+                            }
+                        }
+
+                        double sum = 0.0;
+
+                        for (uint64_t i = first; i < last; i++)
+                        {
+                            for (size_t j = 0; j < d; j++)
+                            {
+                                const double u = (owen_scramble(point[j], seeds[j]) + 0.5) * (1.0 / 4294967296.0);
+                                x[j] = box.lower[j] + u * (box.upper[j] - box.lower[j]);
+                            }
+
+                            sum += f(x.data());
+
+                            // move to the next point in Gray code order
+                            const int k = __builtin_ctzll(~i);
+
+                            for (size_t j = 0; j < d; j++)
+                            {
+                                point[j] ^= v[32*j + k];
+                            }
+                        }
+
+                        block_sums[b] = sum;
+                    }
+                }
+
+                double sum = 0.0;
+
+                for (double block_sum : block_sums)
+                {
+                    sum += block_sum;
+                }
+
+                replicates.add(volume * sum / n);
+            }
+
+            result.estimate = replicates.mean;
+            result.std_error = std::sqrt(replicates.variance() / replicates.n);
+            result.n_samples = n * n_replicates;
+
+            if (result.std_error <= options.target_error)
+            {
+                result.converged = true;
+                break;
+            }
+
+            if (2 * n * n_replicates > options.max_samples || 2 * n >= (uint64_t(1) << 32))
+            {
+                break;
+            }
+
+            n *= 2;
+        }
+
+        return result;
+    }
+}
+
+// Estimate the integral of 'f' over 'box'. 'f' is called as f(x), where x
+// is a const double* pointing to the box.dimension() coordinates of the
+// point, and must be safe to call from several threads at once.
+//
+// With Method::PseudoRandom the points are random and the error falls as
+// 1/sqrt(N). With Method::Sobol they are scrambled Sobol points, and for
+// smooth integrands the error falls almost as 1/N, so far fewer points are
+// needed for the same accuracy. Either way the integration stops once the
+// standard error reaches options.target_error (or after options.max_samples)
+template<class FUNC>
+Result integrate(FUNC f, const Box &box, const Options &options = Options())
+{
+    if (options.method == Method::Sobol)
+    {
+        return detail::integrate_sobol(f, box, options);
+    }
+
+    return detail::integrate_random(f, box, options);
+}
+
+} // end of namespace montecarlo
+
+#endif
@@ -1,49 +1,91 @@
 #include <random>
 #include <cmath>
+#include <algorithm>
+#include <string>
+#include <cstdint>
 #include <iostream>
 #include <omp.h>
 
-int main() {
+// The counter-based random number generator from the TBB workshop.
+// Compile with e.g.
+//   g++ -O3 -fopenmp -I../intro_to_intel_tbb/workshop/include pi_estimate_reduction.cpp
+#include "philox.h"
 
-    std::random_device rd;
-    int pts_inside = 0;
-    int pts_outside = 0;
+// usage: pi_estimate_reduction [seed]
+//
+// As in pi_estimate.cpp, block b of the points always uses Philox stream b
+// of the seed, so for a given seed the estimate is identical for any
+// number of threads or loop schedule (try OMP_SCHEDULE=dynamic,4 with
+// schedule(runtime)). Without a seed, a random one is chosen and printed
 
-    #pragma omp parallel reduction(+ : pts_inside, pts_outside)
+int main(int argc, char **argv) {
+
+    const uint64_t n_points = 100000000;
+    const uint64_t block_size = 1 << 16;
+    const uint64_t n_blocks = (n_points + block_size - 1) / block_size;
+
+    uint64_t seed;
+
+    if (argc > 1)
     {
-        // Set up random number generator stuff
-        std::default_random_engine generator(rd());
-        std::uniform_real_distribution random(-1.0, 1.0);
+        seed = std::stoull(argv[1]);
+    }
+    else
+    {
+        std::random_device rd;
+        seed = (uint64_t(rd()) << 32) | rd();
+    }
 
+    uint64_t pts_inside = 0;
+    uint64_t pts_outside = 0;
+
+    #pragma omp parallel reduction(+ : pts_inside, pts_outside)
+    {
         // Thread number
         // int thread_id = omp_get_thread_num();
 
         // Counters within each thread
-        int thread_pts_inside = 0;
-        int thread_pts_outside = 0;
+        uint64_t thread_pts_inside = 0;
+        uint64_t thread_pts_outside = 0;
 
-        #pragma omp for
-        for (int i = 0; i < 100000000; i++)
+        #pragma omp for schedule(runtime)
+        for (uint64_t b = 0; b < n_blocks; b++)
         {
-            // Generate random x and y coordinates
-            double x = random(generator);
-            double y = random(generator);
-            // Calculate distance from center
-            double distance = std::sqrt(x*x + y*y);
+            // Set up the random number stream for this block
+            part1::Philox4x32 generator(seed, b);
 
-            if (distance <= 1.0)
-            {
-                thread_pts_inside++;
-            }
-            else
+            const uint64_t end = std::min(n_points, (b + 1) * block_size);
+
+            for (uint64_t i = b * block_size; i < end; i++)
             {
-                thread_pts_outside++;
+                // Generate random x and y coordinates in [-1,1), drawing the words
+                // one at a time (the order in which function arguments are
+                // evaluated differs between compilers)
+                const uint32_t x_hi = generator();
+                const uint32_t x_lo = generator();
+                const uint32_t y_hi = generator();
+                const uint32_t y_lo = generator();
+                double x = 2.0 * part1::to_unit_double(x_hi, x_lo) - 1.0;
+                double y = 2.0 * part1::to_unit_double(y_hi, y_lo) - 1.0;
+                // Calculate distance from center
+                double distance = std::sqrt(x*x + y*y);
+
+                if (distance <= 1.0)
+                {
+                    thread_pts_inside++;
+                }
+                else
+                {
+                    thread_pts_outside++;
+                }
             }
         }
 
         double thread_pi_estimate = 4.0 * thread_pts_inside / (thread_pts_inside + thread_pts_outside);
         double thread_n_pts = thread_pts_inside + thread_pts_outside;
 
+        // the counts are integers, so the reduction gives the same total
+        // whatever order the threads are combined in
         pts_inside += thread_pts_inside;
         pts_outside += thread_pts_outside;
 
@@ -57,7 +99,8 @@ int main() {
     }
 
     double pi_estimate = 4.0 * pts_inside / (pts_inside + pts_outside);
-    std::cout << "Estimated value of pi: " << pi_estimate << std::endl;
+    std::cout.precision(17);
+    std::cout << "Estimated value of pi: " << pi_estimate << " (seed " << seed << ")" << std::endl;
 
     return 0;
-}
\ No newline at end of file
+}
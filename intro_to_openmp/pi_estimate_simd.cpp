@@ -0,0 +1,233 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <omp.h>
+
+// A vectorised version of pi_estimate_reduction.cpp, used as a reference
+// for how fast the Monte Carlo estimate of pi can run.
+//
+// Each thread runs LANES independent xoshiro256+ generators side by side,
+// stored as structure-of-arrays so that the compiler can update all of the
+// lanes with one set of SIMD instructions. The random bits are turned into
+// doubles in [0,1) with bit operations, points are tested for being inside
+// the quarter circle using the squared distance (no sqrt, no branch) and
+// counted in 64-bit counters, so 10^11 or more samples can be used.
+//
+// Compile with e.g. g++ -O3 -march=native -fopenmp pi_estimate_simd.cpp
+// usage: pi_estimate_simd [number_of_samples] [seed]
+
+const int LANES = 8;
+
+// xoshiro256+ (Blackman and Vigna), with the state of LANES generators
+struct Xoshiro256Lanes {
+    uint64_t s0[LANES];
+    uint64_t s1[LANES];
+    uint64_t s2[LANES];
+    uint64_t s3[LANES];
+};
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// Advance every lane by one step, writing one output per lane to 'out'
+static inline void next(Xoshiro256Lanes &g, uint64_t *out) {
+    #pragma omp simd
+    for (int l = 0; l < LANES; l++)
+    {
+        out[l] = g.s0[l] + g.s3[l];
+
+        const uint64_t t = g.s1[l] << 17;
+
+        g.s2[l] ^= g.s0[l];
+        g.s3[l] ^= g.s1[l];
+        g.s1[l] ^= g.s2[l];
+        g.s0[l] ^= g.s3[l];
+
+        g.s2[l] ^= t;
+        g.s3[l] = rotl(g.s3[l], 45);
+    }
+}
+
+// Turn the top 52 bits of 'bits' into a double in [0,1), by making them the
+// mantissa of a number in [1,2) and subtracting 1
+static inline double to_unit_double(uint64_t bits) {
+    const uint64_t one = 0x3FF0000000000000ull;
+    const uint64_t u = (bits >> 12) | one;
+    double d;
+    std::memcpy(&d, &u, sizeof(d));
+    return d - 1.0;
+}
+
+// splitmix64, used to turn a seed into a well-mixed starting state
+static inline uint64_t splitmix64(uint64_t &x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Advance a single generator by 2^128 steps. Generators that are 2^128
+// steps apart cannot overlap for any realistic number of samples
+static void jump(uint64_t s[4]) {
+    static const uint64_t JUMP[] = { 0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull,
+                                     0xa9582618e03fc9aaull, 0x39abdc4529b1661cull };
+
+    uint64_t t[4] = { 0, 0, 0, 0 };
+
+    for (int i = 0; i < 4; i++)
+    {
+        for (int b = 0; b < 64; b++)
+        {
+            if (JUMP[i] & (uint64_t(1) << b))
+            {
+                for (int j = 0; j < 4; j++)
+                {
+                    t[j] ^= s[j];
+                }
+            }
+
+            const uint64_t u = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= u;
+            s[3] = rotl(s[3], 45);
+        }
+    }
+
+    std::memcpy(s, t, sizeof(t));
+}
+
+int main(int argc, char **argv) {
+
+    const uint64_t n_samples = (argc > 1) ? uint64_t(std::stod(argv[1])) : 1000000000ull;
+    uint64_t seed = (argc > 2) ? std::stoull(argv[2]) : 42;
+
+    const int n_threads = omp_get_max_threads();
+
+    // lane l of thread t uses the base stream jumped (t*LANES + l) times
+    uint64_t base[4];
+    for (int j = 0; j < 4; j++)
+    {
+        base[j] = splitmix64(seed);
+    }
+
+    std::vector<Xoshiro256Lanes> generators(n_threads);
+
+    for (int t = 0; t < n_threads; t++)
+    {
+        for (int l = 0; l < LANES; l++)
+        {
+            generators[t].s0[l] = base[0];
+            generators[t].s1[l] = base[1];
+            generators[t].s2[l] = base[2];
+            generators[t].s3[l] = base[3];
+            jump(base);
+        }
+    }
+
+    uint64_t pts_inside = 0;
+    std::vector<double> thread_seconds(n_threads, 0.0);
+    std::vector<uint64_t> thread_samples(n_threads, 0);
+
+    // the team may be smaller than omp_get_max_threads() (e.g. with
+    // OMP_DYNAMIC), so only report on the threads that actually ran
+    int team_size = n_threads;
+
+    double start = omp_get_wtime();
+
+    #pragma omp parallel reduction(+ : pts_inside)
+    {
+        const int thread_id = omp_get_thread_num();
+        const int nt = omp_get_num_threads();
+
+        if (thread_id == 0)
+        {
+            team_size = nt;
+        }
+
+        // split the samples into whole blocks of LANES, with any remainder
+        // handled by thread 0 using the first lanes of its last block
+        const uint64_t n_blocks = n_samples / LANES;
+        const uint64_t first = n_blocks * thread_id / nt;
+        const uint64_t last = n_blocks * (thread_id + 1) / nt;
+
+        Xoshiro256Lanes g = generators[thread_id];
+
+        uint64_t inside[LANES] = { 0 };
+        uint64_t xbits[LANES];
+        uint64_t ybits[LANES];
+
+        double thread_start = omp_get_wtime();
+
+        for (uint64_t b = first; b < last; b++)
+        {
+            next(g, xbits);
+            next(g, ybits);
+
+            #pragma omp simd
+            for (int l = 0; l < LANES; l++)
+            {
+                const double x = to_unit_double(xbits[l]);
+                const double y = to_unit_double(ybits[l]);
+
+                inside[l] += (x*x + y*y < 1.0) ? 1 : 0;
+            }
+        }
+
+        uint64_t n_done = (last - first) * LANES;
+
+        if (thread_id == 0)
+        {
+            const int remainder = int(n_samples % LANES);
+
+            next(g, xbits);
+            next(g, ybits);
+
+            for (int l = 0; l < remainder; l++)
+            {
+                const double x = to_unit_double(xbits[l]);
+                const double y = to_unit_double(ybits[l]);
+                inside[l] += (x*x + y*y < 1.0) ? 1 : 0;
+            }
+
+            n_done += remainder;
+        }
+
+        for (int l = 0; l < LANES; l++)
+        {
+            pts_inside += inside[l];
+        }
+
+        thread_seconds[thread_id] = omp_get_wtime() - thread_start;
+        thread_samples[thread_id] = n_done;
+    }
+
+    double seconds = omp_get_wtime() - start;
+
+    for (int t = 0; t < team_size; t++)
+    {
+        if (thread_samples[t] == 0)
+        {
+            continue;
+        }
+
+        std::cout << "Thread " << t << ": " << thread_samples[t] << " points, "
+                  << thread_samples[t] / thread_seconds[t] << " samples/sec" << std::endl;
+    }
+
+    double pi_estimate = 4.0 * double(pts_inside) / double(n_samples);
+
+    std::cout.precision(10);
+    std::cout << "Estimated value of pi: " << pi_estimate << " (" << n_samples << " points)" << std::endl;
+
+    std::cout.precision(4);
+    std::cout << "Total: " << seconds << " s, " << n_samples / seconds << " samples/sec, "
+              << n_samples / seconds / team_size << " samples/sec per thread" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+// [[Rcpp::depends(RcppArmadillo)]]
+#include <RcppArmadillo.h>
+using namespace arma;
+#include "armadillo_lm_funcs.h"
+
+// armadillo_lm_local is shared with armadillo_lm_local.cpp through the header
+
+// Perform k-fold cross-validation for H
+//' Cross-validated bandwidth matrix for local linear regression
+//'
+//' Chooses the bandwidth matrix from `H_values` with the smallest k-fold
+//' cross-validation mean squared error, and refits with it. The folds are
+//' drawn with R's random number generator, so they can be reproduced with
+//' `set.seed()`.
+//'
+//' @inheritParams armadillo_lm_local
+//' @param H_values A list of candidate bandwidth matrices.
+//' @param k_fold Number of folds, from 2 to the number of rows of `x0`.
+//' @return A list with the chosen bandwidth matrix `H` and the `fitted`
+//'   values at `x0`.
+// [[Rcpp::export(name = "armadillo_cv_H")]]
+Rcpp::List armadillo_lm_local_cv(arma::vec& y, arma::mat& x0, arma::mat& X0, arma::mat& x, arma::mat& X, Rcpp::List& H_values, int k_fold) {
+  // Get the number of observations
+  int nrow = x0.n_rows;
+
+  // Every fold needs at least one observation, and k_fold = 0 would divide by zero
+  if (k_fold < 2 || k_fold > nrow) {
+    Rcpp::stop("'k_fold' must be between 2 and the number of observations");
+  }
+  if (H_values.size() == 0) {
+    Rcpp::stop("'H_values' must not be empty");
+  }
+  // Vector of fits
+  vec fitted(nrow);
+  // Vector to store the mean squared errors for each value of H
+  vec mse(H_values.size(), fill::zeros);
+
+  // Split the data into k-folds
+  // Calculate the number of observations in each fold
+  int fold_size = nrow / k_fold;
+  // Create a vector of indices
+  uvec indices = regspace<uvec>(0, nrow - 1);
+  // Shuffle the indices
+  indices = shuffle(indices);
+
+  // Loop over each value of H
+  for (int h = 0; h < H_values.size(); ++h) {
+    mat H = H_values[h];
+    double total_mse = 0.0;
+
+    // Perform k-fold cross-validation
+    for (int fold = 0; fold < k_fold; ++fold) {
+      // Get the indices for the training and test sets
+      uvec test_indices = indices.subvec(fold * fold_size, (fold + 1) * fold_size - 1);
+      uvec train_indices = indices.elem(find(indices < fold * fold_size || indices >= (fold + 1) * fold_size));
+
+      // Get the training and test data
+      mat x0_train = x0.rows(train_indices);
+      mat X0_train = X0.rows(train_indices);
+      vec y_train = y.elem(train_indices);
+      mat x0_test = x0.rows(test_indices);
+      mat X0_test = X0.rows(test_indices);
+      vec y_test = y.elem(test_indices);
+
+      // Fit the model using the training data
+      vec y_test_pred = armadillo_lm_local(y_train, x0_test, X0_test, x0_train, X0_train, H);
+      
+      // Calculate the mean squared error
+      double fold_mse = mean(square(y_test - y_test_pred));
+      total_mse += fold_mse;
+  }
+
+    // Calculate the average mean squared error across the k-folds
+    mse(h) = total_mse / k_fold;
+  }
+
+  // Find the index of the minimum MSE
+  int min_mse_idx = mse.index_min();
+  // Choose the corresponding H value
+  mat best_H = H_values[min_mse_idx];
+
+  // Refit the model using the chosen H and the entire dataset
+  fitted = armadillo_lm_local(y, x0, X0, x, X, best_H);
+
+  // Return a list of the selected H and the fitted values
+  return Rcpp::List::create(Rcpp::Named("H") = best_H,
+                            Rcpp::Named("fitted") = fitted);
+}
+
@@ -0,0 +1,59 @@
+// [[Rcpp::depends(RcppArmadillo)]]
+#include <RcppArmadillo.h>
+using namespace arma;
+#include "armadillo_lm_funcs.h"
+#include "krs_colfile.h"
+
+// Return the values of the double column 'name' of 'file'. Only double
+// columns can be used by Armadillo without copying
+double *mapped_doubles(const krscol::MappedColumns &file, const std::string &name,
+                       uword &n_cols) {
+  const krscol::ColumnEntry &column = file.column(name);
+  
+  if (column.type != krscol::Double) {
+    Rcpp::stop("column '" + name + "' is stored as " + krscol::type_name(column.type) +
+               ", but must be double to be used in place");
+  }
+  
+  n_cols = column.width;
+  return static_cast<double*>(file.data(column));
+}
+
+// Local linear regression, as armadillo_lm_local, with the training data
+// (y, x and X) read from the column file at 'path'. The columns are used
+// where they are mapped, through Armadillo's advanced constructors
+// (copy_aux_mem = false, strict = true), so they are never copied into R
+// or into Armadillo's own memory
+//' Local linear regression of data in a column file
+//'
+//' As `armadillo_lm_local()`, with `y`, `x` and `X` read where they are
+//' mapped from a file written by `write_krs_columns()`. The columns must be
+//' stored as doubles.
+//'
+//' @inheritParams armadillo_lm_local
+//' @param path A file written by `write_krs_columns()`.
+//' @param y_name,x_name,X_name The names of the response, location and
+//'   design matrix columns.
+//' @return A numeric column matrix of the fitted values, one per row of `x0`.
+// [[Rcpp::export(name = "armadillo_lm_local_file")]]
+arma::vec armadillo_lm_local_file(std::string path, arma::mat& x0, arma::mat& X0, arma::mat& H,
+                                  std::string y_name = "y", std::string x_name = "x", std::string X_name = "X") {
+  
+  krscol::MappedColumns file(path);
+  uword n = file.nrows();
+  
+  uword y_cols, x_cols, X_cols;
+  double *y_data = mapped_doubles(file, y_name, y_cols);
+  double *x_data = mapped_doubles(file, x_name, x_cols);
+  double *X_data = mapped_doubles(file, X_name, X_cols);
+  
+  if (y_cols != 1) {
+    Rcpp::stop("column '" + y_name + "' must have width 1");
+  }
+  
+  vec y(y_data, n, false, true);
+  mat x(x_data, n, x_cols, false, true);
+  mat X(X_data, n, X_cols, false, true);
+  
+  return armadillo_lm_local(y, x0, X0, x, X, H);
+}
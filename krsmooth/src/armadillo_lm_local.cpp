@@ -0,0 +1,43 @@
+// [[Rcpp::depends(RcppArmadillo)]]
+#include <RcppArmadillo.h>
+using namespace arma;
+#include "armadillo_lm_funcs.h"
+
+//' Local linear regression
+//'
+//' Fits a weighted least squares regression at each prediction location,
+//' weighting the data by a multivariate Gaussian kernel with covariance `H`
+//' centred on that location.
+//'
+//' @param y Response values.
+//' @param x0 Locations of the predictions, one per row.
+//' @param X0 Design matrix at the prediction locations, one row per row of `x0`.
+//' @param x Locations of the data, one per row, with as many columns as `x0`.
+//' @param X Design matrix at the data, one row per element of `y`.
+//' @param H Bandwidth matrix, which must be positive definite.
+//' @return A numeric column matrix of the fitted values, one per row of `x0`.
+// [[Rcpp::export(name = "armadillo_lm_local")]]
+arma::vec armadillo_lm_local(arma::vec& y, arma::mat& x0, arma::mat& X0, arma::mat& x, arma::mat& X, arma::mat& H) {
+  
+  // Get L for use in dmvnInt
+  mat L = chol(H, "lower");
+  // Get the number of observations
+  int nrow = x0.n_rows;
+  // Vector of fits
+  vec fitted(nrow);
+  // Vector of weights
+  vec weights(nrow);
+  
+  for (int i = 0; i < nrow; i++) {
+    // Get the weights
+    weights = dmvnInt(x, x0.row(i), L);
+    // Get the fitted values
+    mat X_weights = X.each_col() % sqrt(weights);
+    vec y_weights = y % sqrt(weights);
+    vec fit = armadillo_lm(X_weights, y_weights);
+    mat X0_fit = X0.row(i) * fit;
+    fitted(i) = X0_fit(0);
+  }
+  
+  return fitted;
+}
@@ -0,0 +1,63 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/Rdynload.h>
+
+/* Register the package's native routines, so that R finds them directly
+   (no symbol lookup on every .Call) and makes them available to the R
+   code as objects named after the routine */
+
+/* The routines called directly from R */
+extern SEXP meanKRS_C(SEXP y_vec, SEXP x_vec, SEXP x0_vec, SEXP lambda_param);
+extern SEXP krsCV_Cpp(SEXP y_vec, SEXP x_vec, SEXP k_val, SEXP lambda_sequence);
+extern SEXP mean_var_krs_Cpp(SEXP y_vec, SEXP x_vec, SEXP x0_vec, SEXP lambda_param);
+extern SEXP meanKRS_lazy(SEXP y_vec, SEXP x_vec, SEXP x0_vec, SEXP lambda_param, SEXP block_size);
+extern SEXP mean_var_krs_lazy(SEXP y_vec, SEXP x_vec, SEXP x0_vec, SEXP lambda_param, SEXP block_size);
+extern SEXP write_krs_columns_C(SEXP path, SEXP data, SEXP single, SEXP ranges);
+extern SEXP krs_columns_info_C(SEXP path);
+extern SEXP meanKRS_file(SEXP path, SEXP y_name, SEXP x_name, SEXP x0_vec, SEXP lambda_param);
+extern SEXP mean_var_krs_file_Cpp(SEXP path, SEXP y_name, SEXP x_name, SEXP x0_vec, SEXP lambda_param);
+extern SEXP krsCV_file(SEXP path, SEXP y_name, SEXP x_name, SEXP k_val, SEXP lambda_sequence);
+extern SEXP meanKRS_stream(SEXP source, SEXP y_name, SEXP x_name, SEXP x0_vec,
+                           SEXP lambda_param, SEXP chunk_size, SEXP prefetch, SEXP env);
+extern SEXP mean_var_krs_stream_Cpp(SEXP source, SEXP y_name, SEXP x_name, SEXP x0_vec,
+                                    SEXP lambda_param, SEXP chunk_size, SEXP prefetch,
+                                    SEXP grid_size, SEXP env);
+
+/* The Rcpp wrappers in RcppExports.cpp */
+extern SEXP _krsmooth_armadillo_lm_local(SEXP ySEXP, SEXP x0SEXP, SEXP X0SEXP,
+                                         SEXP xSEXP, SEXP XSEXP, SEXP HSEXP);
+extern SEXP _krsmooth_armadillo_lm_local_cv(SEXP ySEXP, SEXP x0SEXP, SEXP X0SEXP,
+                                            SEXP xSEXP, SEXP XSEXP, SEXP H_valuesSEXP,
+                                            SEXP k_foldSEXP);
+extern SEXP _krsmooth_armadillo_lm_local_file(SEXP pathSEXP, SEXP x0SEXP, SEXP X0SEXP, SEXP HSEXP,
+                                              SEXP y_nameSEXP, SEXP x_nameSEXP, SEXP X_nameSEXP);
+
+/* Registers the ALTREP class of lazy predictions (see krs_lazy.cpp) */
+extern void krs_init_altrep(DllInfo *dll);
+
+static const R_CallMethodDef CallEntries[] = {
+  {"meanKRS_C",                        (DL_FUNC) &meanKRS_C,                        4},
+  {"krsCV_Cpp",                        (DL_FUNC) &krsCV_Cpp,                        4},
+  {"mean_var_krs_Cpp",                 (DL_FUNC) &mean_var_krs_Cpp,                 4},
+  {"meanKRS_lazy",                     (DL_FUNC) &meanKRS_lazy,                     5},
+  {"mean_var_krs_lazy",                (DL_FUNC) &mean_var_krs_lazy,                5},
+  {"write_krs_columns_C",              (DL_FUNC) &write_krs_columns_C,              4},
+  {"krs_columns_info_C",               (DL_FUNC) &krs_columns_info_C,               1},
+  {"meanKRS_file",                     (DL_FUNC) &meanKRS_file,                     5},
+  {"mean_var_krs_file_Cpp",            (DL_FUNC) &mean_var_krs_file_Cpp,            5},
+  {"krsCV_file",                       (DL_FUNC) &krsCV_file,                       5},
+  {"meanKRS_stream",                   (DL_FUNC) &meanKRS_stream,                   8},
+  {"mean_var_krs_stream_Cpp",          (DL_FUNC) &mean_var_krs_stream_Cpp,          9},
+  {"_krsmooth_armadillo_lm_local",     (DL_FUNC) &_krsmooth_armadillo_lm_local,     6},
+  {"_krsmooth_armadillo_lm_local_cv",  (DL_FUNC) &_krsmooth_armadillo_lm_local_cv,  7},
+  {"_krsmooth_armadillo_lm_local_file", (DL_FUNC) &_krsmooth_armadillo_lm_local_file, 7},
+  {NULL, NULL, 0}
+};
+
+void R_init_krsmooth(DllInfo *dll)
+{
+  R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
+  R_useDynamicSymbols(dll, FALSE);
+  R_forceSymbols(dll, TRUE);
+  krs_init_altrep(dll);
+}
@@ -0,0 +1,192 @@
+#include <random>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+extern "C" {
+  #include <R.h>
+  #include <Rinternals.h>
+  #include <Rmath.h>
+}
+#include "krs_input.h"
+
+// Use extern "C" to prevent C++ name mangling
+extern "C" {
+  SEXP krsCV_Cpp(SEXP y_vec, SEXP x_vec, SEXP k_val, SEXP lambda_sequence);
+}
+
+// The mean squared error of the kernel regression smoothing estimates at
+// the points outside fold 'fold', using the points in it as the data (as
+// in the original code, the single fold is the training set). 'folds'
+// gives the fold of every point. Rather than copying the two sets into
+// vectors, the data are read a block at a time, and the points of a block
+// that are in each set are gathered into small block-sized buffers. The
+// sums run over the data in order, so the results are the same as
+// smoothing copies of the two sets
+static double fold_mse(DoubleBlocks &y, DoubleBlocks &x, const int *folds,
+                       int fold, double lambda)
+{
+  std::vector<double> x0(x.block_size());
+  std::vector<double> y0(x.block_size());
+  std::vector<double> x_train(x.block_size());
+  std::vector<double> y_train(x.block_size());
+  std::vector<double> sum_dens_norm_y(x.block_size());
+  std::vector<double> sum_dens_norm(x.block_size());
+  
+  double mse = 0;
+  R_xlen_t n_test = 0;
+  
+  for (R_xlen_t b0 = 0; b0 < x.nblocks(); b0++) {
+    // Gather the points of this block to estimate, which are outside the fold
+    const double *x_b0 = x.block(b0);
+    const double *y_b0 = y.block(b0);
+    const int *folds_b0 = folds + x.block_begin(b0);
+    R_xlen_t len0 = 0;
+    
+    for (R_xlen_t i = 0; i < x.block_length(b0); i++) {
+      if (folds_b0[i] != fold) {
+        x0[len0] = x_b0[i];
+        y0[len0] = y_b0[i];
+        len0++;
+      }
+    }
+    
+    std::fill(sum_dens_norm_y.begin(), sum_dens_norm_y.end(), 0.0);
+    std::fill(sum_dens_norm.begin(), sum_dens_norm.end(), 0.0);
+    
+    for (R_xlen_t b = 0; b < x.nblocks(); b++) {
+      // Gather the points of this block that are in the fold
+      const double *x_b = x.block(b);
+      const double *y_b = y.block(b);
+      const int *folds_b = folds + x.block_begin(b);
+      R_xlen_t len = 0;
+      
+      for (R_xlen_t j = 0; j < x.block_length(b); j++) {
+        if (folds_b[j] == fold) {
+          x_train[len] = x_b[j];
+          y_train[len] = y_b[j];
+          len++;
+        }
+      }
+      
+      for (R_xlen_t i = 0; i < len0; i++) {
+        double s_y = sum_dens_norm_y[i];
+        double s = sum_dens_norm[i];
+        
+        for (R_xlen_t j = 0; j < len; j++) {
+          double dens_norm = dnorm(x_train[j], x0[i], lambda, 0);
+          s_y += dens_norm * y_train[j];
+          s += dens_norm;
+        }
+        
+        sum_dens_norm_y[i] = s_y;
+        sum_dens_norm[i] = s;
+      }
+    }
+    
+    for (R_xlen_t i = 0; i < len0; i++) {
+      double mu_pred = sum_dens_norm_y[i] / sum_dens_norm[i];
+      mse += pow(y0[i] - mu_pred, 2);
+    }
+    n_test += len0;
+  }
+  
+  return mse / n_test;
+}
+
+// Function to perform k-fold cross-validation for kernel regression smoothing
+// Takes R objects as input and returns a R vector
+SEXP krsCV_Cpp(SEXP y_vec, SEXP x_vec, SEXP k_val, SEXP lambda_sequence)
+{
+  // Check the inputs before any C++ objects exist, as error() would skip
+  // their destructors
+  check_numeric(y_vec, "y");
+  check_numeric(x_vec, "x");
+  check_numeric(lambda_sequence, "lambdas");
+  
+  if (xlength(y_vec) != xlength(x_vec)) {
+    error("x and y must have the same length");
+  }
+  
+  int k = asInteger(k_val);
+  if (k == NA_INTEGER || k < 2 || k > xlength(x_vec)) {
+    error("'k' must be between 2 and the number of observations");
+  }
+  
+  if (xlength(lambda_sequence) == 0) {
+    error("'lambdas' must not be empty");
+  }
+  
+  SEXP lambdas;
+  PROTECT(lambdas = coerceVector(lambda_sequence, REALSXP));
+  SEXP out;
+  PROTECT(out = allocVector(REALSXP, 1));
+  
+  // Read x and y in place if they are double vectors, and otherwise a
+  // block at a time, rather than coercing them to (unprotected) copies
+  DoubleBlocks x(x_vec);
+  DoubleBlocks y(y_vec);
+  
+  int best = krs_cv_best(y, x, k, REAL(lambdas), length(lambdas));
+  
+  // Create the output
+  REAL(out)[0] = REAL(lambdas)[best];
+  UNPROTECT(2);
+  
+  return out;
+}
+
+// Return the index of the lambda with the smallest k-fold cross-validation
+// mean squared error, reading the data through DoubleBlocks (so that it
+// can come from R vectors or from a column file). The callers check that
+// 2 <= k <= n and that there is at least one lambda
+int krs_cv_best(DoubleBlocks &y, DoubleBlocks &x, int k,
+                const double *lambdas, int lambda_length)
+{
+  int n = x.size();
+  
+  // Create a sequence from 1 to k and repeat it to length n
+  std::vector<int> sequence(n);
+  for (int i = 0; i < n; ++i) {
+    sequence[i] = (i % k) + 1;
+  }
+  // Shuffle the sequence (Fisher-Yates), using R's random number
+  // generator so that the folds can be reproduced with set.seed
+  GetRNGstate();
+  for (int i = n - 1; i > 0; --i) {
+    int j = (int) (unif_rand() * (i + 1));
+    std::swap(sequence[i], sequence[j]);
+  }
+  PutRNGstate();
+  
+  std::vector<double> mse_lambdas(lambda_length);
+  
+  // Loop over the values of lambda
+  for (int l = 0; l < lambda_length; l++) {
+    double lambda_l = lambdas[l];
+    std::vector<double> mse_vec_l(k);
+    // Loop over the k folds, calculating the mean squared error of each
+    for (int i = 0; i < k; i++) {
+      mse_vec_l[i] = fold_mse(y, x, sequence.data(), i + 1, lambda_l);
+    }
+    
+    // Calculate the mean of the mean squared errors for lambda value lambda_l
+    double mean_mse = 0;
+    for (int j = 0; j < k; j++) {
+      mean_mse += mse_vec_l[j];
+    }
+    mean_mse /= k;
+    mse_lambdas[l] = mean_mse;
+  }
+  
+  // Find the lambda value that minimizes the mean squared error
+  double min_mse = mse_lambdas[0];
+  int min_mse_index = 0;
+  for (int i = 1; i < lambda_length; i++) {
+    if (mse_lambdas[i] < min_mse) {
+      min_mse = mse_lambdas[i];
+      min_mse_index = i;
+    }
+  }
+  
+  return min_mse_index;
+}
\ No newline at end of file
@@ -0,0 +1,302 @@
+#include <vector>
+#include <string>
+#include <cstdio>
+// before R's headers, whose macros clash with windows.h
+#include "krs_colfile.h"
+extern "C" {
+  #include <R.h>
+  #include <Rinternals.h>
+  #include <Rmath.h>
+}
+#include "krs_input.h"
+
+// R interfaces to krsmooth column files (see krs_colfile.h): writing R
+// data to a file, describing a file, and running the smoothers on the
+// mapped columns of a file, so that R only passes the file's path.
+//
+// The file code reports errors with C++ exceptions, which must not pass
+// through R, and R's error() jumps straight out, skipping C++ destructors
+// (which would leave files mapped). So each routine allocates its R
+// objects first, catches any exception into 'message', and only calls
+// error() once every C++ object has gone
+
+extern "C" {
+  SEXP write_krs_columns_C(SEXP path, SEXP data, SEXP single, SEXP ranges);
+  SEXP krs_columns_info_C(SEXP path);
+  SEXP meanKRS_file(SEXP path, SEXP y_name, SEXP x_name, SEXP x0_vec, SEXP lambda_param);
+  SEXP mean_var_krs_file_Cpp(SEXP path, SEXP y_name, SEXP x_name, SEXP x0_vec, SEXP lambda_param);
+  SEXP krsCV_file(SEXP path, SEXP y_name, SEXP x_name, SEXP k_val, SEXP lambda_sequence);
+}
+
+static const size_t message_size = 1024;
+
+static std::string string_arg(SEXP s) {
+  return translateChar(asChar(s));
+}
+
+// Return a reader for the single (width 1) column 'name' of 'file'
+static DoubleBlocks column_reader(const krscol::MappedColumns &file, const std::string &name) {
+  const krscol::ColumnEntry &column = file.column(name);
+
+  if (column.width != 1) {
+    throw std::runtime_error("column '" + name + "' must have width 1");
+  }
+
+  const R_xlen_t n = file.nrows();
+  const void *values = file.data(column);
+
+  switch (column.type) {
+    case krscol::Double:
+      return DoubleBlocks(static_cast<const double*>(values), n);
+    case krscol::Int32:
+      return DoubleBlocks(static_cast<const int*>(values), n);
+    default:
+      return DoubleBlocks(static_cast<const float*>(values), n);
+  }
+}
+
+// Write the named list 'data' of numeric vectors and matrices, which all
+// have the same number of rows, to the column file 'path'. Double columns
+// named in 'single' are stored as 4-byte floats
+SEXP write_krs_columns_C(SEXP path, SEXP data, SEXP single, SEXP ranges) {
+
+  SEXP names = getAttrib(data, R_NamesSymbol);
+  R_xlen_t ncolumns = xlength(data);
+
+  if (TYPEOF(data) != VECSXP || names == R_NilValue) {
+    error("'data' must be a named list");
+  }
+
+  // Check everything before any C++ objects exist
+  R_xlen_t nrows = 0;
+  for (R_xlen_t c = 0; c < ncolumns; c++) {
+    SEXP column = VECTOR_ELT(data, c);
+    check_numeric(column, translateChar(STRING_ELT(names, c)));
+
+    R_xlen_t column_rows = isMatrix(column) ? Rf_nrows(column) : xlength(column);
+    if (c == 0) {
+      nrows = column_rows;
+    } else if (column_rows != nrows) {
+      error("every column must have the same number of rows");
+    }
+  }
+
+  char message[message_size] = "";
+
+  try {
+    std::vector<krscol::ColumnData> columns(ncolumns);
+    std::vector< std::vector<float> > floats(ncolumns);
+
+    for (R_xlen_t c = 0; c < ncolumns; c++) {
+      SEXP column = VECTOR_ELT(data, c);
+      krscol::ColumnData &out = columns[c];
+
+      out.name = translateChar(STRING_ELT(names, c));
+      out.width = isMatrix(column) ? Rf_ncols(column) : 1;
+
+      bool as_single = false;
+      for (R_xlen_t s = 0; s < xlength(single); s++) {
+        as_single = as_single || (out.name == translateChar(STRING_ELT(single, s)));
+      }
+
+      if (TYPEOF(column) != REALSXP) {
+        // logical and integer vectors are both stored as int32
+        out.type = krscol::Int32;
+        out.values = (TYPEOF(column) == INTSXP) ? INTEGER(column) : LOGICAL(column);
+      } else if (as_single) {
+        out.type = krscol::Float32;
+        floats[c].assign(REAL(column), REAL(column) + xlength(column));
+        out.values = floats[c].data();
+      } else {
+        out.type = krscol::Double;
+        out.values = REAL(column);
+      }
+    }
+
+    krscol::write_columns(string_arg(path), nrows, columns, asLogical(ranges) == TRUE);
+  } catch (const std::exception &e) {
+    snprintf(message, message_size, "%s", e.what());
+  }
+
+  if (message[0]) {
+    error("%s", message);
+  }
+
+  return R_NilValue;
+}
+
+// Return a list of the number of rows, and the name, type, width and
+// range (NA if not stored) of each column
+SEXP krs_columns_info_C(SEXP path) {
+
+  char message[message_size] = "";
+
+  std::vector<std::string> names;
+  std::vector<const char*> types;
+  std::vector<int> widths;
+  std::vector<double> mins;
+  std::vector<double> maxs;
+  double nrows = 0;
+
+  try {
+    krscol::MappedColumns file(string_arg(path));
+    nrows = file.nrows();
+
+    for (size_t c = 0; c < file.ncolumns(); c++) {
+      const krscol::ColumnEntry &column = file.entry(c);
+      bool has_range = column.flags & krscol::has_range;
+
+      names.push_back(file.name(c));
+      types.push_back(krscol::type_name(column.type));
+      widths.push_back(column.width);
+      mins.push_back(has_range ? column.min : NA_REAL);
+      maxs.push_back(has_range ? column.max : NA_REAL);
+    }
+  } catch (const std::exception &e) {
+    snprintf(message, message_size, "%s", e.what());
+  }
+
+  if (message[0]) {
+    // free the C++ objects before error() jumps out
+    std::vector<std::string>().swap(names);
+    std::vector<const char*>().swap(types);
+    std::vector<int>().swap(widths);
+    std::vector<double>().swap(mins);
+    std::vector<double>().swap(maxs);
+    error("%s", message);
+  }
+
+  int ncolumns = names.size();
+
+  SEXP out = PROTECT(allocVector(VECSXP, 6));
+  SET_VECTOR_ELT(out, 0, ScalarReal(nrows));
+
+  SEXP name = allocVector(STRSXP, ncolumns);
+  SET_VECTOR_ELT(out, 1, name);
+  SEXP type = allocVector(STRSXP, ncolumns);
+  SET_VECTOR_ELT(out, 2, type);
+  SEXP width = allocVector(INTSXP, ncolumns);
+  SET_VECTOR_ELT(out, 3, width);
+  SEXP min = allocVector(REALSXP, ncolumns);
+  SET_VECTOR_ELT(out, 4, min);
+  SEXP max = allocVector(REALSXP, ncolumns);
+  SET_VECTOR_ELT(out, 5, max);
+
+  for (int c = 0; c < ncolumns; c++) {
+    SET_STRING_ELT(name, c, mkChar(names[c].c_str()));
+    SET_STRING_ELT(type, c, mkChar(types[c]));
+    INTEGER(width)[c] = widths[c];
+    REAL(min)[c] = mins[c];
+    REAL(max)[c] = maxs[c];
+  }
+
+  SEXP out_names = PROTECT(allocVector(STRSXP, 6));
+  const char *labels[] = {"nrows", "name", "type", "width", "min", "max"};
+  for (int i = 0; i < 6; i++) {
+    SET_STRING_ELT(out_names, i, mkChar(labels[i]));
+  }
+  setAttrib(out, R_NamesSymbol, out_names);
+
+  UNPROTECT(2);
+  return out;
+}
+
+// mean_krs, with y and x read from the column file at 'path'
+SEXP meanKRS_file(SEXP path, SEXP y_name, SEXP x_name, SEXP x0_vec, SEXP lambda_param) {
+
+  check_numeric(x0_vec, "x0");
+  double lambda = asReal(lambda_param);
+
+  SEXP out = PROTECT(allocVector(REALSXP, xlength(x0_vec)));
+  char message[message_size] = "";
+
+  try {
+    krscol::MappedColumns file(string_arg(path));
+    DoubleBlocks y = column_reader(file, string_arg(y_name));
+    DoubleBlocks x = column_reader(file, string_arg(x_name));
+    DoubleBlocks x0(x0_vec);
+
+    krs_blocked(y, x, x0, [=](R_xlen_t) { return lambda; }, REAL(out));
+  } catch (const std::exception &e) {
+    snprintf(message, message_size, "%s", e.what());
+  }
+
+  if (message[0]) {
+    error("%s", message);
+  }
+
+  UNPROTECT(1);
+  return out;
+}
+
+// mean_var_krs, with y and x read from the column file at 'path'
+SEXP mean_var_krs_file_Cpp(SEXP path, SEXP y_name, SEXP x_name, SEXP x0_vec, SEXP lambda_param) {
+
+  check_numeric(x0_vec, "x0");
+  double lambda = asReal(lambda_param);
+
+  SEXP out = PROTECT(allocVector(REALSXP, xlength(x0_vec)));
+  char message[message_size] = "";
+
+  try {
+    krscol::MappedColumns file(string_arg(path));
+    DoubleBlocks y = column_reader(file, string_arg(y_name));
+    DoubleBlocks x = column_reader(file, string_arg(x_name));
+    DoubleBlocks x_eval = column_reader(file, string_arg(x_name));
+    DoubleBlocks x0(x0_vec);
+
+    mean_var_krs(y, x, x_eval, x0, lambda, REAL(out));
+  } catch (const std::exception &e) {
+    snprintf(message, message_size, "%s", e.what());
+  }
+
+  if (message[0]) {
+    error("%s", message);
+  }
+
+  UNPROTECT(1);
+  return out;
+}
+
+// krs_cv, with y and x read from the column file at 'path'
+SEXP krsCV_file(SEXP path, SEXP y_name, SEXP x_name, SEXP k_val, SEXP lambda_sequence) {
+
+  check_numeric(lambda_sequence, "lambdas");
+
+  // the number of rows is only known once the file is open, so k > n is
+  // reported through 'message' below
+  int k = asInteger(k_val);
+  if (k == NA_INTEGER || k < 2) {
+    error("'k' must be between 2 and the number of observations");
+  }
+
+  if (xlength(lambda_sequence) == 0) {
+    error("'lambdas' must not be empty");
+  }
+
+  SEXP lambdas = PROTECT(coerceVector(lambda_sequence, REALSXP));
+  SEXP out = PROTECT(allocVector(REALSXP, 1));
+  char message[message_size] = "";
+
+  try {
+    krscol::MappedColumns file(string_arg(path));
+    DoubleBlocks y = column_reader(file, string_arg(y_name));
+    DoubleBlocks x = column_reader(file, string_arg(x_name));
+
+    if (k > x.size()) {
+      throw std::runtime_error("'k' must be between 2 and the number of observations");
+    }
+
+    int best = krs_cv_best(y, x, k, REAL(lambdas), length(lambdas));
+    REAL(out)[0] = REAL(lambdas)[best];
+  } catch (const std::exception &e) {
+    snprintf(message, message_size, "%s", e.what());
+  }
+
+  if (message[0]) {
+    error("%s", message);
+  }
+
+  UNPROTECT(2);
+  return out;
+}
@@ -0,0 +1,619 @@
+#ifndef krs_colfile_h
+#define krs_colfile_h
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <climits>
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+
+#ifdef _WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+
+// krsmooth column files: a simple binary format for large datasets, which
+// the smoothing routines can read in place by memory-mapping the file,
+// rather than the data being parsed into (and copied around) R.
+//
+// A file is made of
+//   - a 64-byte header: the magic string "KRSCOLS", the format version,
+//     the number of columns and the number of rows;
+//   - one 64-byte entry per column: its name (up to 23 characters), the
+//     type of its values, its width, where its data start, and optionally
+//     the smallest and largest of its values;
+//   - the data of each column, starting on a 64-byte boundary.
+// A column of width w holds an nrows x w matrix, stored column-major as
+// R and Armadillo do, so that it can be used as a matrix without copying.
+// Numbers are stored in the byte order of the machine that wrote them.
+// Missing values are NaN for floating point columns and INT_MIN (R's
+// NA_integer_) for integer columns, and are left out of the ranges.
+
+namespace krscol {
+
+enum ColumnType : uint32_t
+{
+  Double = 0,
+  Int32 = 1,
+  Float32 = 2
+};
+
+// Columns start on multiples of this, so they suit any vector loads
+const size_t alignment = 64;
+
+const uint32_t format_version = 1;
+
+// Set in ColumnEntry::flags if min and max hold the column's range
+const uint32_t has_range = 1;
+
+struct FileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t ncolumns;
+  uint64_t nrows;
+  char reserved[40];
+};
+
+struct ColumnEntry
+{
+  char name[24];
+  uint32_t type;
+  uint32_t width;
+  uint64_t offset;
+  uint32_t flags;
+  uint32_t reserved;
+  double min;
+  double max;
+};
+
+static_assert(sizeof(FileHeader) == 64, "FileHeader must be 64 bytes");
+static_assert(sizeof(ColumnEntry) == 64, "ColumnEntry must be 64 bytes");
+
+inline size_t type_size(uint32_t type)
+{
+  switch (type)
+  {
+    case Double:  return sizeof(double);
+    case Int32:   return sizeof(int32_t);
+    case Float32: return sizeof(float);
+    default:
+      throw std::runtime_error("unknown column type " + std::to_string(type));
+  }
+}
+
+inline const char *type_name(uint32_t type)
+{
+  switch (type)
+  {
+    case Double:  return "double";
+    case Int32:   return "int32";
+    case Float32: return "float32";
+    default:      return "unknown";
+  }
+}
+
+inline uint64_t aligned(uint64_t offset)
+{
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+inline std::string column_name(const ColumnEntry &e)
+{
+  return std::string(e.name, strnlen(e.name, sizeof(e.name)));
+}
+
+// Check that a file of nbytes bytes starts with 'header', a valid header
+inline void check_header(const std::string &path, const FileHeader &header, uint64_t nbytes)
+{
+  if (nbytes < sizeof(FileHeader) || std::memcmp(header.magic, "KRSCOLS", 8) != 0)
+  {
+    throw std::runtime_error(path + " is not a krsmooth column file");
+  }
+
+  if (header.version != format_version)
+  {
+    throw std::runtime_error(path + " has unsupported format version " +
+                             std::to_string(header.version));
+  }
+
+  if (sizeof(FileHeader) + uint64_t(header.ncolumns) * sizeof(ColumnEntry) > nbytes)
+  {
+    throw std::runtime_error(path + " is truncated");
+  }
+}
+
+// Check that each of the header.ncolumns 'entries' lies inside the file.
+// The column's size is not computed, as nrows * width * type size can
+// overflow for a corrupt header; instead the number of rows is compared
+// with the number that fit between the column's offset and the end
+inline void check_columns(const std::string &path, const FileHeader &header,
+                          const ColumnEntry *entries, uint64_t nbytes)
+{
+  for (size_t c = 0; c < header.ncolumns; c++)
+  {
+    const ColumnEntry &e = entries[c];
+    const uint64_t row_bytes = uint64_t(e.width) * type_size(e.type);
+
+    // a column of width 0 has no data, so fits wherever it starts
+    const bool fits = e.offset <= nbytes &&
+                      (row_bytes == 0 || header.nrows <= (nbytes - e.offset) / row_bytes);
+
+    if (e.offset % alignment != 0 || !fits)
+    {
+      throw std::runtime_error(path + ": column '" + column_name(e) + "' is outside the file");
+    }
+  }
+}
+
+// A column to be written: 'width' runs of nrows values of type 'type'
+struct ColumnData
+{
+  std::string name;
+  uint32_t type;
+  uint32_t width;
+  const void *values;
+};
+
+namespace detail {
+
+template<class T>
+void find_range(const T *values, uint64_t n, double &lo, double &hi)
+{
+  lo = INFINITY;
+  hi = -INFINITY;
+
+  for (uint64_t i = 0; i < n; i++)
+  {
+    const double v = values[i];
+    const bool missing = std::isnan(v) || (std::is_integral<T>::value && v == INT_MIN);
+
+    if (!missing)
+    {
+      lo = (v < lo) ? v : lo;
+      hi = (v > hi) ? v : hi;
+    }
+  }
+}
+
+inline void write_all(FILE *f, const void *data, size_t nbytes, const std::string &path)
+{
+  if (nbytes > 0 && fwrite(data, 1, nbytes, f) != nbytes)
+  {
+    fclose(f);
+    std::remove(path.c_str());
+    throw std::runtime_error("cannot write to " + path);
+  }
+}
+
+} // end of namespace detail
+
+// Write 'columns', each of nrows rows, to 'path'. The file is written
+// under a temporary name and renamed at the end, so readers never see a
+// partly written file. If 'ranges' is set, each column's range is stored
+inline void write_columns(const std::string &path, uint64_t nrows,
+                          const std::vector<ColumnData> &columns, bool ranges)
+{
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, "KRSCOLS", 8);
+  header.version = format_version;
+  header.ncolumns = columns.size();
+  header.nrows = nrows;
+
+  std::vector<ColumnEntry> entries(columns.size());
+  uint64_t offset = sizeof(FileHeader) + columns.size() * sizeof(ColumnEntry);
+
+  for (size_t c = 0; c < columns.size(); c++)
+  {
+    const ColumnData &column = columns[c];
+    ColumnEntry &entry = entries[c];
+    std::memset(&entry, 0, sizeof(entry));
+
+    if (column.name.empty() || column.name.size() >= sizeof(entry.name))
+    {
+      throw std::runtime_error("column names must be 1 to " +
+                               std::to_string(sizeof(entry.name) - 1) + " characters: '" +
+                               column.name + "'");
+    }
+
+    for (size_t other = 0; other < c; other++)
+    {
+      if (columns[other].name == column.name)
+      {
+        throw std::runtime_error("there is more than one column called '" + column.name + "'");
+      }
+    }
+
+    std::memcpy(entry.name, column.name.data(), column.name.size());
+    entry.type = column.type;
+    entry.width = column.width;
+
+    offset = aligned(offset);
+    entry.offset = offset;
+    offset += nrows * column.width * type_size(column.type);
+
+    if (ranges)
+    {
+      const uint64_t n = nrows * column.width;
+
+      switch (column.type)
+      {
+        case Double:
+          detail::find_range(static_cast<const double*>(column.values), n, entry.min, entry.max);
+          break;
+        case Int32:
+          detail::find_range(static_cast<const int32_t*>(column.values), n, entry.min, entry.max);
+          break;
+        default:
+          detail::find_range(static_cast<const float*>(column.values), n, entry.min, entry.max);
+      }
+
+      entry.flags |= has_range;
+    }
+  }
+
+  const std::string tmp = path + ".tmp";
+  FILE *f = std::fopen(tmp.c_str(), "wb");
+
+  if (!f)
+  {
+    throw std::runtime_error("cannot open " + tmp + " for writing");
+  }
+
+  detail::write_all(f, &header, sizeof(header), tmp);
+  detail::write_all(f, entries.data(), entries.size() * sizeof(ColumnEntry), tmp);
+
+  uint64_t written = sizeof(FileHeader) + entries.size() * sizeof(ColumnEntry);
+  const char padding[alignment] = {0};
+
+  for (size_t c = 0; c < columns.size(); c++)
+  {
+    detail::write_all(f, padding, entries[c].offset - written, tmp);
+
+    const uint64_t nbytes = nrows * columns[c].width * type_size(columns[c].type);
+    detail::write_all(f, columns[c].values, nbytes, tmp);
+
+    written = entries[c].offset + nbytes;
+  }
+
+  if (std::fclose(f) != 0)
+  {
+    std::remove(tmp.c_str());
+    throw std::runtime_error("cannot write to " + tmp);
+  }
+
+#ifdef _WIN32
+  // rename does not replace an existing file on Windows
+  std::remove(path.c_str());
+#endif
+
+  if (std::rename(tmp.c_str(), path.c_str()) != 0)
+  {
+    std::remove(tmp.c_str());
+    throw std::runtime_error("cannot rename " + tmp + " to " + path);
+  }
+}
+
+// A column file, memory-mapped so that its columns can be read in place.
+// The mapping is private (copy-on-write), so the column data can be given
+// to code such as Armadillo that wants non-const pointers: any writes
+// change only this process's copy, never the file
+class MappedColumns
+{
+public:
+  explicit MappedColumns(const std::string &path) : path(path), base(NULL), nbytes(0)
+  {
+    map();
+
+    try
+    {
+      validate();
+    }
+    catch (...)
+    {
+      unmap();
+      throw;
+    }
+  }
+
+  ~MappedColumns()
+  {
+    unmap();
+  }
+
+  MappedColumns(const MappedColumns&) = delete;
+  MappedColumns& operator=(const MappedColumns&) = delete;
+
+  uint64_t nrows() const
+  {
+    return header().nrows;
+  }
+
+  size_t ncolumns() const
+  {
+    return header().ncolumns;
+  }
+
+  const ColumnEntry &entry(size_t c) const
+  {
+    return reinterpret_cast<const ColumnEntry*>(base + sizeof(FileHeader))[c];
+  }
+
+  std::string name(size_t c) const
+  {
+    return column_name(entry(c));
+  }
+
+  // Return the entry of the column called 'column_name'
+  const ColumnEntry &column(const std::string &column_name) const
+  {
+    for (size_t c = 0; c < ncolumns(); c++)
+    {
+      if (name(c) == column_name)
+      {
+        return entry(c);
+      }
+    }
+
+    throw std::runtime_error(path + " has no column called '" + column_name + "'");
+  }
+
+  // Return the values of 'e', as 'width' runs of nrows() values
+  void *data(const ColumnEntry &e) const
+  {
+    return base + e.offset;
+  }
+
+private:
+  const FileHeader &header() const
+  {
+    return *reinterpret_cast<const FileHeader*>(base);
+  }
+
+  void validate() const
+  {
+    check_header(path, header(), nbytes);
+    check_columns(path, header(), &entry(0), nbytes);
+  }
+
+#ifdef _WIN32
+  void map()
+  {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+      throw std::runtime_error("cannot open " + path);
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    nbytes = size.QuadPart;
+
+    HANDLE mapping = (nbytes > 0) ? CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL) : NULL;
+    base = mapping ? static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0)) : NULL;
+
+    if (mapping)
+    {
+      CloseHandle(mapping);
+    }
+    CloseHandle(file);
+
+    if (!base)
+    {
+      throw std::runtime_error("cannot map " + path);
+    }
+  }
+
+  void unmap()
+  {
+    if (base)
+    {
+      UnmapViewOfFile(base);
+      base = NULL;
+    }
+  }
+#else
+  void map()
+  {
+    const int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+      throw std::runtime_error("cannot open " + path);
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+      close(fd);
+      throw std::runtime_error(path + " is not a krsmooth column file");
+    }
+
+    nbytes = st.st_size;
+    void *p = mmap(NULL, nbytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (p == MAP_FAILED)
+    {
+      throw std::runtime_error("cannot map " + path);
+    }
+
+    // the smoothers scan the columns from start to end
+    madvise(p, nbytes, MADV_SEQUENTIAL);
+
+    base = static_cast<char*>(p);
+  }
+
+  void unmap()
+  {
+    if (base)
+    {
+      munmap(base, nbytes);
+      base = NULL;
+    }
+  }
+#endif
+
+  std::string path;
+  char *base;
+  uint64_t nbytes;
+};
+
+// A column file read with ordinary file reads, a range of rows at a time,
+// for files too large to be worth mapping (or for when the reads should
+// overlap with computation, see krs_stream.cpp). Integer and float columns
+// are converted to doubles as they are read, with missing values as NaN
+class ColumnReader
+{
+public:
+  explicit ColumnReader(const std::string &path) : path(path), file(std::fopen(path.c_str(), "rb"))
+  {
+    if (!file)
+    {
+      throw std::runtime_error("cannot open " + path);
+    }
+
+    try
+    {
+      seek(0, SEEK_END);
+      const uint64_t nbytes = tell();
+
+      std::memset(&header, 0, sizeof(header));
+      seek(0, SEEK_SET);
+      if (nbytes >= sizeof(header))
+      {
+        read_all(&header, sizeof(header));
+      }
+      check_header(path, header, nbytes);
+
+      entries.resize(header.ncolumns);
+      read_all(entries.data(), entries.size() * sizeof(ColumnEntry));
+      check_columns(path, header, entries.data(), nbytes);
+    }
+    catch (...)
+    {
+      std::fclose(file);
+      throw;
+    }
+  }
+
+  ~ColumnReader()
+  {
+    std::fclose(file);
+  }
+
+  ColumnReader(const ColumnReader&) = delete;
+  ColumnReader& operator=(const ColumnReader&) = delete;
+
+  uint64_t nrows() const
+  {
+    return header.nrows;
+  }
+
+  // Return the entry of the column called 'name', which must have width 1
+  const ColumnEntry &column(const std::string &name) const
+  {
+    for (const ColumnEntry &e : entries)
+    {
+      if (column_name(e) == name)
+      {
+        if (e.width != 1)
+        {
+          throw std::runtime_error("column '" + name + "' must have width 1");
+        }
+
+        return e;
+      }
+    }
+
+    throw std::runtime_error(path + " has no column called '" + name + "'");
+  }
+
+  // Read rows [begin, begin + n) of 'column' into 'out' as doubles
+  void read(const ColumnEntry &column, uint64_t begin, size_t n, double *out)
+  {
+    const size_t size = type_size(column.type);
+    seek(column.offset + begin * size, SEEK_SET);
+
+    if (column.type == Double)
+    {
+      read_all(out, n * sizeof(double));
+      return;
+    }
+
+    scratch.resize(n * size);
+    read_all(scratch.data(), scratch.size());
+
+    if (column.type == Int32)
+    {
+      const int32_t *values = reinterpret_cast<const int32_t*>(scratch.data());
+
+      for (size_t i = 0; i < n; i++)
+      {
+        out[i] = (values[i] == INT_MIN) ? NAN : values[i];
+      }
+    }
+    else
+    {
+      const float *values = reinterpret_cast<const float*>(scratch.data());
+      std::copy(values, values + n, out);
+    }
+  }
+
+private:
+  void seek(uint64_t offset, int whence)
+  {
+#ifdef _WIN32
+    const int failed = _fseeki64(file, offset, whence);
+#else
+    const int failed = fseeko(file, offset, whence);
+#endif
+
+    if (failed)
+    {
+      throw std::runtime_error("cannot seek in " + path);
+    }
+  }
+
+  uint64_t tell()
+  {
+#ifdef _WIN32
+    return _ftelli64(file);
+#else
+    return ftello(file);
+#endif
+  }
+
+  void read_all(void *data, size_t nbytes)
+  {
+    if (nbytes > 0 && std::fread(data, 1, nbytes, file) != nbytes)
+    {
+      throw std::runtime_error("cannot read " + path);
+    }
+  }
+
+  std::string path;
+  FILE *file;
+  FileHeader header;
+  std::vector<ColumnEntry> entries;
+  std::vector<char> scratch;
+};
+
+} // end of namespace krscol
+
+#endif
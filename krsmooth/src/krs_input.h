@@ -0,0 +1,218 @@
+#ifndef krs_input_h
+#define krs_input_h
+
+#include <vector>
+#include <algorithm>
+extern "C" {
+  #include <R.h>
+  #include <Rinternals.h>
+  #include <Rmath.h>
+}
+
+// Reading numeric arguments of .Call routines without copying them.
+//
+// coerceVector allocates a whole double copy of an integer or logical
+// vector (and returns the vector itself for a double vector). Instead,
+// DoubleBlocks hands out the values as doubles one block at a time: an
+// ordinary double vector is read in place, while integer and logical
+// vectors (and ALTREP double vectors without a data pointer, e.g. lazy
+// predictions from krs_lazy.cpp) are converted a block at a time into a
+// small buffer. No R objects are allocated, so nothing needs protecting
+// beyond the arguments themselves, which R already protects.
+
+// Check that 'vec' can be read by DoubleBlocks. Call this for every input
+// before constructing any C++ objects, as error() does not run destructors
+inline void check_numeric(SEXP vec, const char *name)
+{
+  switch (TYPEOF(vec))
+  {
+    case REALSXP:
+    case INTSXP:
+    case LGLSXP:
+      return;
+    default:
+      error("'%s' must be a numeric vector", name);
+  }
+}
+
+class DoubleBlocks
+{
+public:
+  static const R_xlen_t default_block_size = 4096;
+
+  // Read the R vector 'vec', which must have passed check_numeric
+  explicit DoubleBlocks(SEXP vec, R_xlen_t block_size = default_block_size)
+    : vec(vec), n(xlength(vec)), bsize(block_size), data(NULL), current(-1)
+  {
+    if (TYPEOF(vec) == REALSXP)
+    {
+      data = static_cast<const double*>(DATAPTR_OR_NULL(vec));
+    }
+
+    if (!data)
+    {
+      buffer.resize(std::min(n, bsize));
+
+      if (TYPEOF(vec) != REALSXP)
+      {
+        ints.resize(std::min(n, bsize));
+      }
+    }
+  }
+
+  // Read n doubles that are already in memory, e.g. intermediate results
+  // or a column of a mapped file (see krs_colfile.h)
+  DoubleBlocks(const double *values, R_xlen_t n, R_xlen_t block_size = default_block_size)
+    : vec(R_NilValue), n(n), bsize(block_size), data(values), current(-1)
+  {}
+
+  // Read n ints (with NA_INTEGER missing) or floats that are in memory,
+  // converting them a block at a time
+  DoubleBlocks(const int *values, R_xlen_t n, R_xlen_t block_size = default_block_size)
+    : vec(R_NilValue), n(n), bsize(block_size), data(NULL), int_values(values),
+      current(-1), buffer(std::min(n, block_size))
+  {}
+
+  DoubleBlocks(const float *values, R_xlen_t n, R_xlen_t block_size = default_block_size)
+    : vec(R_NilValue), n(n), bsize(block_size), data(NULL), float_values(values),
+      current(-1), buffer(std::min(n, block_size))
+  {}
+
+  R_xlen_t size() const { return n; }
+  R_xlen_t block_size() const { return bsize; }
+  R_xlen_t nblocks() const { return (n + bsize - 1) / bsize; }
+  R_xlen_t block_begin(R_xlen_t b) const { return b * bsize; }
+  R_xlen_t block_length(R_xlen_t b) const { return std::min(bsize, n - b * bsize); }
+
+  // Return the values in block b. Unless they are read in place, they are
+  // in a buffer that is overwritten by the next call for a different block
+  const double *block(R_xlen_t b)
+  {
+    const R_xlen_t begin = block_begin(b);
+
+    if (data)
+    {
+      return data + begin;
+    }
+
+    if (b != current)
+    {
+      const R_xlen_t len = block_length(b);
+      const int *block_ints = int_values ? int_values + begin : ints.data();
+
+      if (float_values)
+      {
+        std::copy(float_values + begin, float_values + begin + len, buffer.begin());
+      }
+      else if (!int_values)
+      {
+        switch (TYPEOF(vec))
+        {
+          case REALSXP:
+            REAL_GET_REGION(vec, begin, len, buffer.data());
+            break;
+          case INTSXP:
+            INTEGER_GET_REGION(vec, begin, len, ints.data());
+            break;
+          default:
+            LOGICAL_GET_REGION(vec, begin, len, ints.data());
+        }
+      }
+
+      if (int_values || (vec != R_NilValue && TYPEOF(vec) != REALSXP))
+      {
+        for (R_xlen_t k = 0; k < len; k++)
+        {
+          buffer[k] = (block_ints[k] == NA_INTEGER) ? NA_REAL : block_ints[k];
+        }
+      }
+
+      current = b;
+    }
+
+    return buffer.data();
+  }
+
+private:
+  SEXP vec;
+  R_xlen_t n;
+  R_xlen_t bsize;
+
+  // the values, if they can be read in place
+  const double *data;
+
+  // or the ints or floats to convert, if they are not in an R vector
+  const int *int_values = NULL;
+  const float *float_values = NULL;
+
+  // the block held in 'buffer', converted through 'ints' if needed
+  R_xlen_t current;
+  std::vector<double> buffer;
+  std::vector<int> ints;
+};
+
+// The kernel regression smoothing estimates at every point of x0, where
+// bandwidth(i) gives the bandwidth to use at x0[i]. The points are taken
+// a block of x0 at a time, and for each block the data are read a block
+// at a time, so that nothing needs converting in full and the blocks in
+// use stay in cache. For each point the sums are over the data in order,
+// so the results are the same as the straightforward double loop
+template<class BANDWIDTH>
+void krs_blocked(DoubleBlocks &y, DoubleBlocks &x, DoubleBlocks &x0,
+                 BANDWIDTH bandwidth, double *out)
+{
+  std::vector<double> sum_dens_norm_y(x0.block_size());
+  std::vector<double> sum_dens_norm(x0.block_size());
+
+  for (R_xlen_t b0 = 0; b0 < x0.nblocks(); b0++)
+  {
+    const R_xlen_t begin0 = x0.block_begin(b0);
+    const R_xlen_t len0 = x0.block_length(b0);
+    const double *x0_b = x0.block(b0);
+
+    std::fill(sum_dens_norm_y.begin(), sum_dens_norm_y.end(), 0.0);
+    std::fill(sum_dens_norm.begin(), sum_dens_norm.end(), 0.0);
+
+    for (R_xlen_t b = 0; b < x.nblocks(); b++)
+    {
+      const R_xlen_t len = x.block_length(b);
+      const double *x_b = x.block(b);
+      const double *y_b = y.block(b);
+
+      for (R_xlen_t i = 0; i < len0; i++)
+      {
+        const double bw = bandwidth(begin0 + i);
+        double s_y = sum_dens_norm_y[i];
+        double s = sum_dens_norm[i];
+
+        for (R_xlen_t j = 0; j < len; j++)
+        {
+          double dens_norm = dnorm(x_b[j], x0_b[i], bw, 0);
+          s_y += dens_norm * y_b[j];
+          s += dens_norm;
+        }
+
+        sum_dens_norm_y[i] = s_y;
+        sum_dens_norm[i] = s;
+      }
+    }
+
+    for (R_xlen_t i = 0; i < len0; i++)
+    {
+      out[begin0 + i] = sum_dens_norm_y[i] / sum_dens_norm[i];
+    }
+  }
+}
+
+// The smoothing routines, which read their data through DoubleBlocks so
+// that it can come from R vectors or from a column file (krs_colfile.cpp)
+
+// Defined in krsCV_Cpp.cpp
+int krs_cv_best(DoubleBlocks &y, DoubleBlocks &x, int k,
+                const double *lambdas, int lambda_length);
+
+// Defined in mean_var_krs_Cpp.cpp
+void mean_var_krs(DoubleBlocks &y, DoubleBlocks &x, DoubleBlocks &x_eval,
+                  DoubleBlocks &x0, double lambda, double *out);
+
+#endif
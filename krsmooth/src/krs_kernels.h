@@ -0,0 +1,29 @@
+#ifndef krs_kernels_h
+#define krs_kernels_h
+
+extern "C" {
+  #include <R.h>
+  #include <Rinternals.h>
+  #include <Rmath.h>
+}
+
+// The kernel regression smoothing estimate at the point x0: the mean of
+// the n values y, weighted by a Gaussian kernel (standard deviation lambda)
+// of the distance from each x to x0. This is the inner loop of meanKRS_C
+inline double krs_at(const double *y, const double *x, R_xlen_t n,
+                     double x0, double lambda)
+{
+  double sum_dens_norm_y = 0;
+  double sum_dens_norm = 0;
+  
+  for (R_xlen_t j = 0; j < n; j++)
+  {
+    double dens_norm = dnorm(x[j], x0, lambda, 0);
+    sum_dens_norm_y += dens_norm * y[j];
+    sum_dens_norm += dens_norm;
+  }
+  
+  return sum_dens_norm_y / sum_dens_norm;
+}
+
+#endif
@@ -0,0 +1,282 @@
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+extern "C" {
+  #include <R.h>
+  #include <Rinternals.h>
+  #include <R_ext/Rdynload.h>
+  #include <R_ext/Altrep.h>
+}
+#include "krs_kernels.h"
+
+// Lazily evaluated kernel regression predictions.
+//
+// mean_krs(..., lazy = TRUE) and mean_var_krs(..., lazy = TRUE) return an
+// ALTREP numeric vector that holds the fitted model rather than the
+// predictions. An element is only computed when it is read, and it is
+// computed together with the rest of its block of 'block_size' grid points,
+// which is then cached. Reading a small window of a huge prediction grid
+// therefore only costs the blocks in that window. Anything that needs all
+// of the data at once (e.g. sum(), or passing the vector to C code through
+// REAL()) computes every block and keeps the result as an ordinary vector.
+
+extern "C" {
+  SEXP meanKRS_lazy(SEXP y_vec, SEXP x_vec, SEXP x0_vec, SEXP lambda_param, SEXP block_size);
+  SEXP mean_var_krs_lazy(SEXP y_vec, SEXP x_vec, SEXP x0_vec, SEXP lambda_param, SEXP block_size);
+  void krs_init_altrep(DllInfo *dll);
+}
+
+// The state of a lazy prediction vector
+struct LazyKRS {
+  std::vector<double> y;
+  std::vector<double> x;
+  
+  // the prediction grid, kept alive by the external pointer holding this
+  const double *x0;
+  R_xlen_t n0;
+  
+  double lambda;
+  
+  // the bandwidth at grid point i is lambda * w[i], or lambda if w is empty
+  std::vector<double> w;
+  
+  // the cache of computed blocks (null until computed)
+  R_xlen_t block_size;
+  std::vector<std::unique_ptr<double[]>> blocks;
+  
+  // Return block b, computing it if it has not been computed before. This
+  // is reached from the Elt and Get_region methods, which C and C++ code
+  // can call with objects that need cleaning up, so it must never jump out
+  // (e.g. by checking for an interrupt)
+  const double *block(R_xlen_t b) {
+    if (!blocks[b]) {
+      R_xlen_t begin = b * block_size;
+      R_xlen_t end = std::min(n0, begin + block_size);
+      std::unique_ptr<double[]> values(new double[end - begin]);
+      
+      for (R_xlen_t i = begin; i < end; i++) {
+        double bandwidth = w.empty() ? lambda : lambda * w[i];
+        values[i - begin] = krs_at(y.data(), x.data(), x.size(), x0[i], bandwidth);
+      }
+      
+      blocks[b] = std::move(values);
+    }
+    
+    return blocks[b].get();
+  }
+};
+
+static R_altrep_class_t lazy_krs_class;
+
+static void lazy_krs_finalize(SEXP ptr) {
+  LazyKRS *model = static_cast<LazyKRS*>(R_ExternalPtrAddr(ptr));
+  delete model;
+  R_ClearExternalPtr(ptr);
+}
+
+static LazyKRS *lazy_krs_model(SEXP x) {
+  return static_cast<LazyKRS*>(R_ExternalPtrAddr(R_altrep_data1(x)));
+}
+
+// data2 holds the predictions as an ordinary vector once they have all
+// been computed, and is NULL until then
+static SEXP lazy_krs_materialize(SEXP x) {
+  SEXP full = R_altrep_data2(x);
+  
+  if (full == R_NilValue) {
+    LazyKRS *model = lazy_krs_model(x);
+    PROTECT(full = allocVector(REALSXP, model->n0));
+    double *out = REAL(full);
+    
+    R_xlen_t nblocks = model->blocks.size();
+    for (R_xlen_t b = 0; b < nblocks; b++) {
+      // Materialising can take a while, so allow an interrupt between
+      // blocks. This path already allocates (and so can jump out), and
+      // the model stays valid: any blocks dropped from the cache are
+      // just computed again
+      R_CheckUserInterrupt();
+      
+      R_xlen_t begin = b * model->block_size;
+      R_xlen_t end = std::min(model->n0, begin + model->block_size);
+      const double *values = model->block(b);
+      std::copy(values, values + (end - begin), out + begin);
+      // the cached block is no longer needed
+      model->blocks[b].reset();
+    }
+    
+    R_set_altrep_data2(x, full);
+    UNPROTECT(1);
+  }
+  
+  return full;
+}
+
+static R_xlen_t lazy_krs_length(SEXP x) {
+  SEXP full = R_altrep_data2(x);
+  return (full != R_NilValue) ? XLENGTH(full) : lazy_krs_model(x)->n0;
+}
+
+static Rboolean lazy_krs_inspect(SEXP x, int pre, int deep, int pvec,
+                                 void (*inspect_subtree)(SEXP, int, int, int)) {
+  LazyKRS *model = lazy_krs_model(x);
+  R_xlen_t ncomputed = 0;
+  
+  for (const auto &b : model->blocks) {
+    ncomputed += b ? 1 : 0;
+  }
+  
+  Rprintf(" lazy KRS predictions (n = %ld, grid = %ld, %s, %ld of %ld blocks computed)\n",
+          (long) model->x.size(), (long) model->n0,
+          (R_altrep_data2(x) != R_NilValue) ? "materialized" : "not materialized",
+          (long) ncomputed, (long) model->blocks.size());
+  return TRUE;
+}
+
+static void *lazy_krs_dataptr(SEXP x, Rboolean writeable) {
+  return REAL(lazy_krs_materialize(x));
+}
+
+static const void *lazy_krs_dataptr_or_null(SEXP x) {
+  SEXP full = R_altrep_data2(x);
+  return (full != R_NilValue) ? REAL(full) : NULL;
+}
+
+static double lazy_krs_elt(SEXP x, R_xlen_t i) {
+  SEXP full = R_altrep_data2(x);
+  
+  if (full != R_NilValue) {
+    return REAL(full)[i];
+  }
+  
+  LazyKRS *model = lazy_krs_model(x);
+  return model->block(i / model->block_size)[i % model->block_size];
+}
+
+static R_xlen_t lazy_krs_get_region(SEXP x, R_xlen_t i, R_xlen_t n, double *buf) {
+  SEXP full = R_altrep_data2(x);
+  LazyKRS *model = lazy_krs_model(x);
+  
+  R_xlen_t end = std::min(i + n, lazy_krs_length(x));
+  
+  if (full != R_NilValue) {
+    std::copy(REAL(full) + i, REAL(full) + end, buf);
+    return end - i;
+  }
+  
+  // copy from each block that overlaps [i, end)
+  for (R_xlen_t k = i; k < end; ) {
+    R_xlen_t b = k / model->block_size;
+    R_xlen_t block_end = std::min(end, (b + 1) * model->block_size);
+    const double *values = model->block(b);
+    std::copy(values + (k - b * model->block_size),
+              values + (block_end - b * model->block_size), buf + (k - i));
+    k = block_end;
+  }
+  
+  return end - i;
+}
+
+static int lazy_krs_no_na(SEXP x) {
+  return 0;
+}
+
+void krs_init_altrep(DllInfo *dll) {
+  lazy_krs_class = R_make_altreal_class("lazy_krs", "krsmooth", dll);
+  
+  R_set_altrep_Length_method(lazy_krs_class, lazy_krs_length);
+  R_set_altrep_Inspect_method(lazy_krs_class, lazy_krs_inspect);
+  R_set_altvec_Dataptr_method(lazy_krs_class, lazy_krs_dataptr);
+  R_set_altvec_Dataptr_or_null_method(lazy_krs_class, lazy_krs_dataptr_or_null);
+  R_set_altreal_Elt_method(lazy_krs_class, lazy_krs_elt);
+  R_set_altreal_Get_region_method(lazy_krs_class, lazy_krs_get_region);
+  R_set_altreal_No_NA_method(lazy_krs_class, lazy_krs_no_na);
+}
+
+// Wrap 'model' (whose x0 points into x0_vec) in a new lazy vector
+static SEXP new_lazy_krs(LazyKRS *model, SEXP x0_vec, SEXP block_size) {
+  model->block_size = std::max(1, asInteger(block_size));
+  model->blocks.resize((model->n0 + model->block_size - 1) / model->block_size);
+  
+  // the external pointer keeps x0_vec alive for as long as the model
+  SEXP ptr = PROTECT(R_MakeExternalPtr(model, R_NilValue, x0_vec));
+  R_RegisterCFinalizerEx(ptr, lazy_krs_finalize, TRUE);
+  
+  SEXP out = R_new_altrep(lazy_krs_class, ptr, R_NilValue);
+  UNPROTECT(1);
+  return out;
+}
+
+// Copy the training data and set up the model. x0_vec must already be a
+// protected REALSXP
+static LazyKRS *make_model(SEXP y_vec, SEXP x_vec, SEXP x0_vec, SEXP lambda_param) {
+  R_xlen_t n = xlength(x_vec);
+  
+  if (xlength(y_vec) != n) {
+    error("x and y must have the same length");
+  }
+  
+  std::unique_ptr<LazyKRS> model(new LazyKRS);
+  
+  SEXP x = PROTECT(coerceVector(x_vec, REALSXP));
+  SEXP y = PROTECT(coerceVector(y_vec, REALSXP));
+  model->x.assign(REAL(x), REAL(x) + n);
+  model->y.assign(REAL(y), REAL(y) + n);
+  UNPROTECT(2);
+  
+  model->x0 = REAL(x0_vec);
+  model->n0 = xlength(x0_vec);
+  model->lambda = asReal(lambda_param);
+  
+  return model.release();
+}
+
+SEXP meanKRS_lazy(SEXP y_vec, SEXP x_vec, SEXP x0_vec, SEXP lambda_param, SEXP block_size) {
+  SEXP x0 = PROTECT(coerceVector(x0_vec, REALSXP));
+  
+  LazyKRS *model = make_model(y_vec, x_vec, x0, lambda_param);
+  SEXP out = new_lazy_krs(model, x0, block_size);
+  
+  UNPROTECT(1);
+  return out;
+}
+
+// As mean_var_krs_Cpp, except that the final fit is lazy. The bandwidth
+// weights are normalised by their mean over the whole grid, so the
+// smoothed absolute residuals (madHat) have to be computed at every grid
+// point up front; only the final reweighted fit is deferred
+SEXP mean_var_krs_lazy(SEXP y_vec, SEXP x_vec, SEXP x0_vec, SEXP lambda_param, SEXP block_size) {
+  SEXP x0 = PROTECT(coerceVector(x0_vec, REALSXP));
+  
+  LazyKRS *model = make_model(y_vec, x_vec, x0, lambda_param);
+  SEXP out = PROTECT(new_lazy_krs(model, x0, block_size));
+  
+  const double *x = model->x.data();
+  const double *y = model->y.data();
+  R_xlen_t n = model->x.size();
+  R_xlen_t n0 = model->n0;
+  double lambda = model->lambda;
+  
+  // Absolute residuals of the fit at the training points
+  std::vector<double> resAbs(n);
+  for (R_xlen_t i = 0; i < n; i++) {
+    resAbs[i] = std::abs(y[i] - krs_at(y, x, n, x[i], lambda));
+  }
+  
+  // Smooth the absolute residuals over the grid, and turn them into
+  // bandwidth weights with a mean of 1
+  std::vector<double> &w = model->w;
+  w.resize(n0);
+  double mean_w = 0;
+  for (R_xlen_t i = 0; i < n0; i++) {
+    w[i] = 1 / krs_at(resAbs.data(), x, n, model->x0[i], lambda);
+    mean_w += w[i];
+  }
+  mean_w = mean_w / n0;
+  for (R_xlen_t i = 0; i < n0; i++) {
+    w[i] = w[i] / mean_w;
+  }
+  
+  UNPROTECT(2);
+  return out;
+}
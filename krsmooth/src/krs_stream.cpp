@@ -0,0 +1,542 @@
+#include <vector>
+#include <string>
+#include <memory>
+#include <future>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+// before R's headers, whose macros clash with windows.h
+#include "krs_colfile.h"
+extern "C" {
+  #include <R.h>
+  #include <Rinternals.h>
+  #include <Rmath.h>
+}
+#include "krs_input.h"
+
+// Out-of-core kernel regression smoothing, for training data too large to
+// hold in memory.
+//
+// The data are streamed in chunks of x and y, either from a column file
+// (see krs_colfile.h) or from an R function that returns one chunk per
+// call. Each point of x0 only needs the two sums of its estimate (kernel
+// weighted y, and kernel weights), so those are accumulated for all of x0
+// as each chunk goes past, and the chunk is then discarded. Only x0, the
+// sums and one or two chunks are ever in memory. For file sources, the
+// next chunk can be read on a background thread while the current one is
+// being used.
+//
+// The errors and interrupts of this code are handled as in krs_colfile.cpp:
+// exceptions are caught into a message, and error() is only called once
+// every C++ object (and so the background thread) has gone
+
+extern "C" {
+  SEXP meanKRS_stream(SEXP source, SEXP y_name, SEXP x_name, SEXP x0_vec,
+                      SEXP lambda_param, SEXP chunk_size, SEXP prefetch, SEXP env);
+  SEXP mean_var_krs_stream_Cpp(SEXP source, SEXP y_name, SEXP x_name, SEXP x0_vec,
+                           SEXP lambda_param, SEXP chunk_size, SEXP prefetch,
+                           SEXP grid_size, SEXP env);
+}
+
+static const size_t message_size = 1024;
+
+struct Chunk {
+  std::vector<double> x;
+  std::vector<double> y;
+};
+
+// A source of chunks of training data, which can be read more than once
+class ChunkSource {
+public:
+  virtual ~ChunkSource() {}
+
+  // Go back to the first chunk
+  virtual void rewind() = 0;
+
+  // Read the next chunk into 'chunk', returning false if there are no more
+  virtual bool next(Chunk &chunk) = 0;
+
+  // Set lo and hi to the range of x, if the source knows it without
+  // reading the data, and otherwise return false
+  virtual bool stored_range(double &lo, double &hi) {
+    return false;
+  }
+};
+
+// Chunks of chunk_size rows of the y and x columns of a column file
+class FileChunks : public ChunkSource {
+public:
+  FileChunks(const std::string &path, const std::string &y_name,
+             const std::string &x_name, size_t chunk_size)
+    : reader(path), y_column(reader.column(y_name)), x_column(reader.column(x_name)),
+      chunk_size(chunk_size), row(0)
+  {}
+
+  void rewind() {
+    row = 0;
+  }
+
+  bool next(Chunk &chunk) {
+    const uint64_t n = std::min<uint64_t>(chunk_size, reader.nrows() - row);
+
+    if (n == 0) {
+      return false;
+    }
+
+    chunk.x.resize(n);
+    chunk.y.resize(n);
+    reader.read(x_column, row, n, chunk.x.data());
+    reader.read(y_column, row, n, chunk.y.data());
+
+    row += n;
+    return true;
+  }
+
+  bool stored_range(double &lo, double &hi) {
+    if (!(x_column.flags & krscol::has_range)) {
+      return false;
+    }
+
+    lo = x_column.min;
+    hi = x_column.max;
+    return true;
+  }
+
+private:
+  krscol::ColumnReader reader;
+  krscol::ColumnEntry y_column;
+  krscol::ColumnEntry x_column;
+  size_t chunk_size;
+  uint64_t row;
+};
+
+// Chunks returned by the R function f: f(i) returns the i-th chunk (from
+// 1) as a list with numeric elements x and y, or NULL after the last one.
+// This must only be used from R's thread
+class CallbackChunks : public ChunkSource {
+public:
+  CallbackChunks(SEXP f, SEXP env) : f(f), env(env), i(0)
+  {}
+
+  void rewind() {
+    i = 0;
+  }
+
+  bool next(Chunk &chunk) {
+    SEXP index = PROTECT(ScalarInteger(++i));
+    SEXP call = PROTECT(lang2(f, index));
+    int failed = 0;
+    SEXP result = R_tryEval(call, env, &failed);
+    PROTECT(result);
+
+    // check the result without throwing while anything is protected
+    const char *problem = NULL;
+    SEXP x = R_NilValue;
+    SEXP y = R_NilValue;
+
+    if (failed) {
+      problem = "the chunk function failed";
+    } else if (result != R_NilValue) {
+      x = list_element(result, "x");
+      y = list_element(result, "y");
+
+      if (!is_numeric(x) || !is_numeric(y)) {
+        problem = "the chunk function must return a list with numeric x and y, or NULL";
+      } else if (xlength(x) != xlength(y)) {
+        problem = "the x and y of a chunk must have the same length";
+      }
+    }
+
+    if (!problem && result != R_NilValue) {
+      copy(x, chunk.x);
+      copy(y, chunk.y);
+    }
+
+    UNPROTECT(3);
+
+    if (problem) {
+      throw std::runtime_error(std::string(problem) + " (chunk " + std::to_string(i) + ")");
+    }
+
+    return result != R_NilValue;
+  }
+
+private:
+  static SEXP list_element(SEXP list, const char *name) {
+    SEXP names = getAttrib(list, R_NamesSymbol);
+
+    if (TYPEOF(list) == VECSXP && names != R_NilValue) {
+      for (R_xlen_t k = 0; k < xlength(list); k++) {
+        if (strcmp(CHAR(STRING_ELT(names, k)), name) == 0) {
+          return VECTOR_ELT(list, k);
+        }
+      }
+    }
+
+    return R_NilValue;
+  }
+
+  static bool is_numeric(SEXP vec) {
+    return TYPEOF(vec) == REALSXP || TYPEOF(vec) == INTSXP || TYPEOF(vec) == LGLSXP;
+  }
+
+  static void copy(SEXP vec, std::vector<double> &out) {
+    DoubleBlocks blocks(vec);
+    out.resize(blocks.size());
+
+    for (R_xlen_t b = 0; b < blocks.nblocks(); b++) {
+      const double *values = blocks.block(b);
+      std::copy(values, values + blocks.block_length(b), out.begin() + blocks.block_begin(b));
+    }
+  }
+
+  SEXP f;
+  SEXP env;
+  int i;
+};
+
+// Reads the chunks of another source one ahead, on a background thread,
+// so that reading the next chunk overlaps with using the current one.
+// The other source must not use R
+class PrefetchChunks : public ChunkSource {
+public:
+  explicit PrefetchChunks(std::unique_ptr<ChunkSource> source) : source(std::move(source))
+  {}
+
+  ~PrefetchChunks() {
+    wait();
+  }
+
+  void rewind() {
+    wait();
+    source->rewind();
+  }
+
+  bool next(Chunk &chunk) {
+    if (!pending.valid()) {
+      start();
+    }
+
+    // get() rethrows anything thrown while reading
+    const bool found = pending.get();
+
+    if (found) {
+      // hand over the chunk that was read ahead, and reuse the old one's
+      // memory for the next read
+      std::swap(chunk, ahead);
+      start();
+    }
+
+    return found;
+  }
+
+  bool stored_range(double &lo, double &hi) {
+    return source->stored_range(lo, hi);
+  }
+
+private:
+  void start() {
+    pending = std::async(std::launch::async, [this] { return source->next(ahead); });
+  }
+
+  void wait() {
+    if (pending.valid()) {
+      try {
+        pending.get();
+      } catch (...) {
+        // the read is not wanted any more, so neither is its error
+      }
+    }
+  }
+
+  std::unique_ptr<ChunkSource> source;
+  Chunk ahead;
+  std::future<bool> pending;
+};
+
+static void check_interrupt(void *) {
+  R_CheckUserInterrupt();
+}
+
+// Throw if the user has interrupted R, without jumping out of the C++ code
+static void check_for_interrupt() {
+  if (R_ToplevelExec(check_interrupt, NULL) == FALSE) {
+    throw std::runtime_error("interrupted");
+  }
+}
+
+// Stream every chunk of 'source' once, and return the KRS estimates at x0,
+// where bandwidth(i) is the bandwidth to use at x0[i]. 'residuals', if
+// given, replaces each chunk's y with some function of its x and y before
+// it is used
+template<class BANDWIDTH, class RESIDUALS>
+std::vector<double> krs_stream(ChunkSource &source, const std::vector<double> &x0,
+                               BANDWIDTH bandwidth, RESIDUALS residuals) {
+  const size_t n0 = x0.size();
+
+  std::vector<double> sum_dens_norm_y(n0, 0.0);
+  std::vector<double> sum_dens_norm(n0, 0.0);
+
+  Chunk chunk;
+  source.rewind();
+
+  while (source.next(chunk)) {
+    residuals(chunk);
+
+    const size_t n = chunk.x.size();
+    const double *x = chunk.x.data();
+    const double *y = chunk.y.data();
+
+    for (size_t i = 0; i < n0; i++) {
+      const double bw = bandwidth(i);
+      double s_y = sum_dens_norm_y[i];
+      double s = sum_dens_norm[i];
+
+      for (size_t j = 0; j < n; j++) {
+        double dens_norm = dnorm(x[j], x0[i], bw, 0);
+        s_y += dens_norm * y[j];
+        s += dens_norm;
+      }
+
+      sum_dens_norm_y[i] = s_y;
+      sum_dens_norm[i] = s;
+    }
+
+    check_for_interrupt();
+  }
+
+  std::vector<double> out(n0);
+  for (size_t i = 0; i < n0; i++) {
+    out[i] = sum_dens_norm_y[i] / sum_dens_norm[i];
+  }
+
+  return out;
+}
+
+// Linear interpolation of the values 'mu' at the points 'x0', which need
+// not be sorted, taking the end values beyond the range of x0. Points
+// where mu is NaN (e.g. too far from any data for the kernel weights to
+// be non-zero) are skipped, so the values either side are joined instead
+class Interpolator {
+public:
+  Interpolator(const std::vector<double> &x0, const std::vector<double> &mu) {
+    std::vector<size_t> order(x0.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return x0[a] < x0[b]; });
+
+    for (size_t i : order) {
+      if (!std::isnan(x0[i]) && !std::isnan(mu[i])) {
+        x.push_back(x0[i]);
+        y.push_back(mu[i]);
+      }
+    }
+  }
+
+  double operator()(double at) const {
+    if (x.empty() || std::isnan(at)) {
+      return NAN;
+    }
+
+    const size_t k = std::upper_bound(x.begin(), x.end(), at) - x.begin();
+
+    if (k == 0) {
+      return y.front();
+    }
+    if (k == x.size()) {
+      return y.back();
+    }
+
+    const double t = (at - x[k-1]) / (x[k] - x[k-1]);
+    return y[k-1] + t * (y[k] - y[k-1]);
+  }
+
+private:
+  std::vector<double> x;
+  std::vector<double> y;
+};
+
+// Set lo and hi to the range of the finite x values of 'source': the range
+// stored in a column file if there is one, and otherwise by reading the
+// data (x only, with no smoothing). Returns false if there are none
+static bool data_range(ChunkSource &source, double &lo, double &hi) {
+  if (source.stored_range(lo, hi) && std::isfinite(lo) && std::isfinite(hi)) {
+    return lo <= hi;
+  }
+
+  lo = INFINITY;
+  hi = -INFINITY;
+
+  Chunk chunk;
+  source.rewind();
+
+  while (source.next(chunk)) {
+    for (double x : chunk.x) {
+      if (std::isfinite(x)) {
+        lo = std::min(lo, x);
+        hi = std::max(hi, x);
+      }
+    }
+
+    check_for_interrupt();
+  }
+
+  return lo <= hi;
+}
+
+// 'size' points evenly spread over [lo, hi], including both ends
+static std::vector<double> make_grid(double lo, double hi, size_t size) {
+  std::vector<double> grid(size);
+
+  for (size_t i = 0; i < size; i++) {
+    grid[i] = lo + (hi - lo) * i / (size - 1);
+  }
+  grid[size - 1] = hi;
+
+  return grid;
+}
+
+// Return the source of chunks described by the R arguments
+static std::unique_ptr<ChunkSource> make_source(SEXP source, SEXP y_name, SEXP x_name,
+                                                SEXP chunk_size, SEXP prefetch, SEXP env) {
+  if (isFunction(source)) {
+    return std::unique_ptr<ChunkSource>(new CallbackChunks(source, env));
+  }
+
+  std::unique_ptr<ChunkSource> file(new FileChunks(translateChar(asChar(source)),
+                                                   translateChar(asChar(y_name)),
+                                                   translateChar(asChar(x_name)),
+                                                   std::max(1, asInteger(chunk_size))));
+
+  if (asLogical(prefetch) == TRUE) {
+    return std::unique_ptr<ChunkSource>(new PrefetchChunks(std::move(file)));
+  }
+
+  return file;
+}
+
+static std::vector<double> read_x0(SEXP x0_vec) {
+  DoubleBlocks blocks(x0_vec);
+  std::vector<double> x0(blocks.size());
+
+  for (R_xlen_t b = 0; b < blocks.nblocks(); b++) {
+    const double *values = blocks.block(b);
+    std::copy(values, values + blocks.block_length(b), x0.begin() + blocks.block_begin(b));
+  }
+
+  return x0;
+}
+
+// mean_krs, with the training data streamed from 'source'
+SEXP meanKRS_stream(SEXP source, SEXP y_name, SEXP x_name, SEXP x0_vec,
+                    SEXP lambda_param, SEXP chunk_size, SEXP prefetch, SEXP env) {
+
+  check_numeric(x0_vec, "x0");
+  double lambda = asReal(lambda_param);
+
+  SEXP out = PROTECT(allocVector(REALSXP, xlength(x0_vec)));
+  char message[message_size] = "";
+
+  try {
+    std::unique_ptr<ChunkSource> chunks = make_source(source, y_name, x_name,
+                                                      chunk_size, prefetch, env);
+    std::vector<double> x0 = read_x0(x0_vec);
+
+    std::vector<double> fit = krs_stream(*chunks, x0, [=](size_t) { return lambda; },
+                                         [](Chunk &) {});
+
+    std::copy(fit.begin(), fit.end(), REAL(out));
+  } catch (const std::exception &e) {
+    snprintf(message, message_size, "%s", e.what());
+  }
+
+  if (message[0]) {
+    error("%s", message);
+  }
+
+  UNPROTECT(1);
+  return out;
+}
+
+// mean_var_krs, with the training data streamed from 'source'. The data
+// are streamed three times:
+//   1. to fit the mean (mu) on a grid of grid_size points spread evenly
+//      over the range of x;
+//   2. to smooth the absolute residuals, |y - mu(x)|, at x0 (madHat), with
+//      mu(x) interpolated from the fit on the grid, as the data points are
+//      not kept to evaluate the fit at;
+//   3. to refit the mean with the bandwidths scaled by the weights from
+//      madHat (which are normalised over all of x0, so need all of pass 2)
+// The grid depends only on the data, so mu(x) does not depend on how
+// many points x0 has or where they are. The range of x comes from the
+// file if it was stored, and otherwise from reading x once beforehand
+SEXP mean_var_krs_stream_Cpp(SEXP source, SEXP y_name, SEXP x_name, SEXP x0_vec,
+                         SEXP lambda_param, SEXP chunk_size, SEXP prefetch,
+                         SEXP grid_size, SEXP env) {
+
+  check_numeric(x0_vec, "x0");
+  double lambda = asReal(lambda_param);
+
+  int n_grid = asInteger(grid_size);
+  if (n_grid == NA_INTEGER || n_grid < 2) {
+    error("'grid_size' must be at least 2");
+  }
+
+  SEXP out = PROTECT(allocVector(REALSXP, xlength(x0_vec)));
+  char message[message_size] = "";
+
+  try {
+    std::unique_ptr<ChunkSource> chunks = make_source(source, y_name, x_name,
+                                                      chunk_size, prefetch, env);
+    std::vector<double> x0 = read_x0(x0_vec);
+    size_t n0 = x0.size();
+
+    // Fit the kernel regression smoothing model using lambda, on a grid
+    // over the range of the data (no grid if there are no finite x)
+    double lo = 0;
+    double hi = 0;
+    std::vector<double> grid;
+    if (data_range(*chunks, lo, hi)) {
+      grid = make_grid(lo, hi, n_grid);
+    }
+
+    std::vector<double> mu = krs_stream(*chunks, grid, [=](size_t) { return lambda; },
+                                        [](Chunk &) {});
+
+    // Fit a KRS model with the same lambda to the absolute residuals
+    Interpolator mu_at(grid, mu);
+    std::vector<double> w = krs_stream(*chunks, x0, [=](size_t) { return lambda; },
+                                       [&](Chunk &chunk) {
+      for (size_t j = 0; j < chunk.x.size(); j++) {
+        chunk.y[j] = std::abs(chunk.y[j] - mu_at(chunk.x[j]));
+      }
+    });
+
+    // Calculate the weights from madHat, in place
+    double mean_w = 0;
+    for (size_t i = 0; i < n0; i++) {
+      w[i] = 1 / w[i];
+      mean_w += w[i];
+    }
+    mean_w = mean_w / n0;
+    for (size_t i = 0; i < n0; i++) {
+      w[i] = w[i] / mean_w;
+    }
+
+    // Refit, where the lambda parameter is the product of lambda and the weight
+    std::vector<double> fit = krs_stream(*chunks, x0, [&](size_t i) { return lambda * w[i]; },
+                                         [](Chunk &) {});
+
+    std::copy(fit.begin(), fit.end(), REAL(out));
+  } catch (const std::exception &e) {
+    snprintf(message, message_size, "%s", e.what());
+  }
+
+  if (message[0]) {
+    error("%s", message);
+  }
+
+  UNPROTECT(1);
+  return out;
+}
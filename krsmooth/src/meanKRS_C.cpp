@@ -0,0 +1,43 @@
+extern "C" {
+  #include <R.h>
+  #include <Rinternals.h>
+  #include <Rmath.h>
+}
+#include "krs_input.h"
+
+// Use extern "C" to prevent C++ name mangling
+extern "C" {
+  SEXP meanKRS_C(SEXP y_vec, SEXP x_vec, SEXP x0_vec, SEXP lambda_param);
+}
+
+SEXP meanKRS_C(SEXP y_vec, SEXP x_vec, SEXP x0_vec, SEXP lambda_param)
+{
+  
+  // Check the inputs before any C++ objects exist, as error() would skip
+  // their destructors
+  check_numeric(y_vec, "y");
+  check_numeric(x_vec, "x");
+  check_numeric(x0_vec, "x0");
+  
+  if (xlength(y_vec) != xlength(x_vec)) {
+    error("x and y must have the same length");
+  }
+  
+  double lambda = asReal(lambda_param);
+  
+  // Set up and protect output vector
+  SEXP out = PROTECT(allocVector(REALSXP, xlength(x0_vec)));
+  
+  // Read the inputs in place if they are double vectors, and otherwise a
+  // block at a time, rather than coercing them to (unprotected) copies
+  DoubleBlocks y(y_vec);
+  DoubleBlocks x(x_vec);
+  DoubleBlocks x0(x0_vec);
+  
+  // The ratio of the sums of dnorm * y and of dnorm at each point of x0
+  krs_blocked(y, x, x0, [=](R_xlen_t) { return lambda; }, REAL(out));
+  
+  UNPROTECT(1);
+  
+  return out;
+}
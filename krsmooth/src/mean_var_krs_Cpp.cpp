@@ -0,0 +1,96 @@
+#include <vector>
+#include <cmath>
+extern "C" {
+  #include <R.h>
+  #include <Rinternals.h>
+  #include <Rmath.h>
+}
+#include "krs_input.h"
+
+// Use extern "C" to prevent C++ name mangling
+extern "C" {
+  SEXP mean_var_krs_Cpp(SEXP y_vec, SEXP x_vec, SEXP x0_vec, SEXP lambda_param);
+}
+
+SEXP mean_var_krs_Cpp(SEXP y_vec, SEXP x_vec, SEXP x0_vec, SEXP lambda_param) {
+  
+  // Check the inputs before any C++ objects exist, as error() would skip
+  // their destructors
+  check_numeric(y_vec, "y");
+  check_numeric(x_vec, "x");
+  check_numeric(x0_vec, "x0");
+  
+  R_xlen_t n = xlength(x_vec);
+  R_xlen_t n0 = xlength(x0_vec);
+  double lambda = asReal(lambda_param);
+  
+  if (xlength(y_vec) != n) {
+    error("x and y must have the same length");
+  }
+  
+  SEXP out;
+  PROTECT(out = allocVector(REALSXP, n0));
+  
+  // Read the inputs in place if they are double vectors, and otherwise a
+  // block at a time (x is read as the data and as the evaluation points,
+  // so it has a reader for each)
+  DoubleBlocks y(y_vec);
+  DoubleBlocks x(x_vec);
+  DoubleBlocks x_eval(x_vec);
+  DoubleBlocks x0(x0_vec);
+  
+  mean_var_krs(y, x, x_eval, x0, lambda, REAL(out));
+  
+  UNPROTECT(1);
+  return out;
+  
+}
+
+// The heteroscedastic fit at x0, written to out. x and x_eval must be
+// separate readers of the same data, as the data are read both as the
+// training data and as the points at which the first fit is evaluated
+void mean_var_krs(DoubleBlocks &y, DoubleBlocks &x, DoubleBlocks &x_eval,
+                  DoubleBlocks &x0, double lambda, double *out)
+{
+  R_xlen_t n = x.size();
+  R_xlen_t n0 = x0.size();
+  
+  // Fit the kernel regression smoothing model using lambda, at the
+  // data points (mu)
+  std::vector<double> resAbs(n);
+  krs_blocked(y, x, x_eval, [=](R_xlen_t) { return lambda; }, resAbs.data());
+  
+  // Replace mu with the absolute residuals from the original fitted model
+  for (R_xlen_t b = 0; b < y.nblocks(); b++) {
+    const double *y_b = y.block(b);
+    double *res_b = resAbs.data() + y.block_begin(b);
+    for (R_xlen_t i = 0; i < y.block_length(b); i++) {
+      res_b[i] = std::abs(y_b[i] - res_b[i]);
+    }
+  }
+  
+  // Fit a KRS model with the same lambda to estimate the absolute
+  // residuals at x0 (madHat)
+  std::vector<double> w(n0);
+  DoubleBlocks res(resAbs.data(), n);
+  krs_blocked(res, x, x0, [=](R_xlen_t) { return lambda; }, w.data());
+  
+  // Calculate the weights from madHat, in place
+  for (R_xlen_t i = 0; i < n0; i++) {
+    w[i] = 1 / w[i];
+  }
+  double mean_w = 0;
+  for (R_xlen_t i = 0; i < n0; i++) {
+    mean_w += w[i];
+  }
+  mean_w = mean_w / n0;
+  for (R_xlen_t i = 0; i < n0; i++) {
+    w[i] = w[i] / mean_w;
+  }
+  
+  // Fit a KRS model to the original data
+  // Where the lambda parameter is the product of lambda and the weight
+  const double *weights = w.data();
+  krs_blocked(y, x, x0, [=](R_xlen_t i) { return lambda * weights[i]; }, out);
+  
+}
\ No newline at end of file